@@ -26,6 +26,7 @@
 
 #include "libqdma_export.h"
 
+#include <linux/bug.h>
 #include "qdma_descq.h"
 #include "qdma_device.h"
 #include "qdma_thread.h"
@@ -258,12 +259,13 @@ static int qdma_request_wait_for_cmpl(struct xlnx_dma_dev *xdev,
 	else
 		qdma_waitq_wait_event(cb->wq, cb->done);
 
-	lock_descq(descq);
+	/** the request can be on either the work or the pending list */
+	lock_descq_all(descq);
 	/** if the call back is not done, request timed out
 	 *  delete the request list
 	 */
 	if (!cb->done)
-		list_del(&cb->list);
+		qdma_descq_cancel_request(descq, req);
 
 	/** if the call back is not done but the status is updated
 	 *  return i/o error
@@ -280,12 +282,12 @@ static int qdma_request_wait_for_cmpl(struct xlnx_dma_dev *xdev,
 				cb->status,
 			req->timeout_ms);
 		qdma_descq_dump(descq, NULL, 0, 1);
-		unlock_descq(descq);
+		unlock_descq_all(descq);
 
 		return -EIO;
 	}
 
-	unlock_descq(descq);
+	unlock_descq_all(descq);
 	return 0;
 }
 
@@ -446,6 +448,42 @@ int qdma_queue_get_config(unsigned long dev_hndl, unsigned long id,
 	return 0;
 }
 
+/*****************************************************************************/
+/**
+ * qdma_queue_fp_hndl() - resolve the fast path handle of a queue
+ *
+ * @param[in]	dev_hndl:	dev_hndl retured from qdma_device_open()
+ * @param[in]	qhndl:		hndl retured from qdma_queue_add()
+ *
+ * @return	pointer to the descq on success
+ * @return	NULL on failure
+ *****************************************************************************/
+struct qdma_descq *qdma_queue_fp_hndl(unsigned long dev_hndl,
+				      unsigned long qhndl)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_descq *descq;
+
+	/** make sure that the dev_hndl passed is Valid */
+	if (!xdev) {
+		pr_err("dev_hndl is NULL");
+		return NULL;
+	}
+
+	if (xdev_check_hndl(__func__, xdev->conf.pdev, dev_hndl) < 0) {
+		pr_err("Invalid dev_hndl passed");
+		return NULL;
+	}
+
+	descq = qdma_device_get_descq_by_id(xdev, qhndl, NULL, 0, 0);
+	if (!descq) {
+		pr_err("Invalid qid(%lu)", qhndl);
+		return NULL;
+	}
+
+	return descq;
+}
+
 /*****************************************************************************/
 /**
  * qdma_device_capabilities_info() - retrieve the capabilities of a device.
@@ -1020,14 +1058,20 @@ int qdma_queue_remove(unsigned long dev_hndl, unsigned long id, char *buf,
 	}
 #endif
 
-	lock_descq(descq);
+	lock_descq_all(descq);
 	descq->q_state = Q_STATE_DISABLED;
-	unlock_descq(descq);
+	unlock_descq_all(descq);
 
 #ifndef __QDMA_VF__
 	if (xdev->conf.qdma_drv_mode == LEGACY_INTR_MODE)
 		intr_legacy_clear(descq);
 #endif
+	/** the caller may free what the queue callbacks use once the queue
+	 *  is removed, stopping many queues pays a single grace period
+	 */
+	if ((xdev->conf.qdma_drv_mode != POLL_MODE) &&
+		(xdev->conf.qdma_drv_mode != LEGACY_INTR_MODE))
+		intr_q_tbl_sync(descq);
 	snprintf(buf, buflen, "queue %s, id %u deleted.\n",
 		descq->conf.name, descq->conf.qidx);
 
@@ -1520,13 +1564,13 @@ int qdma_queue_add(unsigned long dev_hndl, struct qdma_queue_conf *qconf,
 				continue;
 
 			descq += i;
-			lock_descq(descq);
+			lock_descq_all(descq);
 
 			/** set the descq as enabled*/
 			descq->q_state = Q_STATE_ENABLED;
 			/** assign the qidx */
 			qconf->qidx = i;
-			unlock_descq(descq);
+			unlock_descq_all(descq);
 
 			break;
 		}
@@ -1555,21 +1599,21 @@ int qdma_queue_add(unsigned long dev_hndl, struct qdma_queue_conf *qconf,
 
 		descq += qconf->qidx;
 
-		lock_descq(descq);
+		lock_descq_all(descq);
 
 		/** set the descq as enabled*/
 		descq->q_state = Q_STATE_ENABLED;
 
-		unlock_descq(descq);
+		unlock_descq_all(descq);
 	}
 
 	/** prepare the queue resources*/
 	rv = qdma_device_prep_q_resource(xdev);
 	if (rv < 0) {
 #ifdef __QDMA_VF__
-		lock_descq(descq);
+		lock_descq_all(descq);
 		descq->q_state = Q_STATE_DISABLED;
-		unlock_descq(descq);
+		unlock_descq_all(descq);
 #endif
 		return rv;
 	}
@@ -1798,6 +1842,9 @@ int qdma_queue_start(unsigned long dev_hndl, unsigned long id,
 		return rv;
 	}
 
+	/** keep the global csr slots of the context from being reprogrammed */
+	qdma_descq_csr_slots_ref(descq, true);
+
 	/** program the hw contexts*/
 	rv = qdma_descq_prog_hw(descq);
 	if (rv < 0) {
@@ -1811,15 +1858,13 @@ int qdma_queue_start(unsigned long dev_hndl, unsigned long id,
 
 	/** Interrupt mode */
 	if (descq->xdev->num_vecs) {
-		unsigned long flags;
-		struct intr_info_t *dev_intr_info_list =
-			&descq->xdev->dev_intr_info_list[descq->intr_id];
-
-		spin_lock_irqsave(&dev_intr_info_list->vec_q_list, flags);
-		list_add_tail(&descq->intr_list,
-				&dev_intr_info_list->intr_list);
-		dev_intr_info_list->intr_list_cnt++;
-		spin_unlock_irqrestore(&dev_intr_info_list->vec_q_list, flags);
+		rv = intr_q_tbl_add(descq);
+		if (rv < 0) {
+			snprintf(buf, buflen,
+				"%s interrupt setup failed.\n",
+				descq->conf.name);
+			goto clear_context;
+		}
 	}
 
 	qdma_thread_add_work(descq);
@@ -1828,15 +1873,16 @@ int qdma_queue_start(unsigned long dev_hndl, unsigned long id,
 			descq->conf.name, descq->conf.qidx);
 
 	/** set the descq to online state*/
-	lock_descq(descq);
+	lock_descq_all(descq);
 	descq->q_state = Q_STATE_ONLINE;
-	unlock_descq(descq);
+	unlock_descq_all(descq);
 
 	return 0;
 
 clear_context:
 	qdma_descq_context_clear(descq->xdev, descq->qidx_hw,
 					descq->conf.st, descq->conf.q_type, 1);
+	qdma_descq_csr_slots_ref(descq, false);
 	qdma_descq_free_resource(descq);
 
 	return rv;
@@ -1902,7 +1948,45 @@ int qdma_get_queue_state(unsigned long dev_hndl, unsigned long id,
 	return 0;
 }
 
+int qdma_queue_get_irq(unsigned long dev_hndl, unsigned long id)
+{
+	struct qdma_descq *descq;
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
 
+	/** make sure that the dev_hndl passed is Valid */
+	if (!xdev) {
+		pr_err("dev_hndl is NULL");
+		return -EINVAL;
+	}
+
+	if ((xdev->conf.qdma_drv_mode == POLL_MODE) ||
+			(xdev->conf.qdma_drv_mode == LEGACY_INTR_MODE) ||
+			!xdev->num_vecs)
+		return -EINVAL;
+
+	descq = qdma_device_get_descq_by_id(xdev, id, NULL, 0, 0);
+	if (!descq) {
+		pr_err("Invalid qid(%lu)", id);
+		return -EINVAL;
+	}
+
+	return xdev->msix[descq->intr_id].vector;
+}
+
+
+
+/* fail a request that is still queued when the queue stops */
+static void qdma_request_abort(struct qdma_request *req)
+{
+	struct qdma_sgt_req_cb *cb = qdma_req_cb_get(req);
+
+	cb->done = 1;
+	cb->status = -ENXIO;
+	if (req->fp_done)
+		req->fp_done(req, 0, -ENXIO);
+	else
+		qdma_waitq_wakeup(&cb->wq);
+}
 
 /*****************************************************************************/
 /**
@@ -1924,6 +2008,7 @@ int qdma_queue_stop(unsigned long dev_hndl, unsigned long id, char *buf,
 	struct qdma_sgt_req_cb *cb, *tmp;
 	struct qdma_request *req;
 	unsigned int pend_list_empty = 0;
+	unsigned int i;
 
 	/** make sure that input buffer is not empty, else return error */
 	if (!buf || !buflen) {
@@ -1951,10 +2036,10 @@ int qdma_queue_stop(unsigned long dev_hndl, unsigned long id, char *buf,
 		return -EINVAL;
 	}
 
-	lock_descq(descq);
+	lock_descq_all(descq);
 		/** if the descq not online donot proceed */
 	if (descq->q_state != Q_STATE_ONLINE) {
-		unlock_descq(descq);
+		unlock_descq_all(descq);
 		pr_err("%s invalid state, q_state %d.\n",
 		descq->conf.name, descq->q_state);
 		snprintf(buf, buflen,
@@ -1965,37 +2050,37 @@ int qdma_queue_stop(unsigned long dev_hndl, unsigned long id, char *buf,
 	pend_list_empty = descq->pend_list_empty;
 
 	descq->q_stop_wait = 1;
-	unlock_descq(descq);
+	unlock_descq_all(descq);
 	if (!pend_list_empty) {
 		qdma_waitq_wait_event_timeout(descq->pend_list_wq,
 			descq->pend_list_empty,
 			msecs_to_jiffies(QDMA_Q_PEND_LIST_COMPLETION_TIMEOUT));
 	}
-	lock_descq(descq);
+	lock_descq_all(descq);
 	/** free the descq by updating the state */
 	descq->q_state = Q_STATE_ENABLED;
 	descq->q_stop_wait = 0;
+	/** ST C2H read requests */
 	list_for_each_entry_safe(cb, tmp, &descq->pend_list, list) {
 		req = (struct qdma_request *)cb;
-		cb->done = 1;
-		cb->status = -ENXIO;
-		if (req->fp_done) {
+		if (req->fp_done)
 			list_del(&cb->list);
-			req->fp_done(req, 0, -ENXIO);
-		} else
-			qdma_waitq_wakeup(&cb->wq);
+		qdma_request_abort(req);
 	}
-	list_for_each_entry_safe(cb, tmp, &descq->work_list, list) {
-		req = (struct qdma_request *)cb;
-		cb->done = 1;
-		cb->status = -ENXIO;
-		if (req->fp_done) {
-			qdma_work_queue_del(descq, cb);
-			req->fp_done(req, 0, -ENXIO);
-		} else
-			qdma_waitq_wakeup(&cb->wq);
+	/** H2C and MM requests submitted to hw */
+	for (i = 0; descq->req_ring && i < descq->conf.rngsz; i++) {
+		req = descq->req_ring[i];
+		if (!req)
+			continue;
+		descq->req_ring[i] = NULL;
+		qdma_request_abort(req);
 	}
-	unlock_descq(descq);
+	/** H2C and MM requests not submitted yet */
+	while (descq->work_ring && (req = qdma_work_queue_first_entry(descq))) {
+		qdma_work_queue_pop(descq);
+		qdma_request_abort(req);
+	}
+	unlock_descq_all(descq);
 
 	/** remove the work thread associated with the current queue */
 	qdma_thread_remove_work(descq);
@@ -2003,26 +2088,28 @@ int qdma_queue_stop(unsigned long dev_hndl, unsigned long id, char *buf,
 	/** clear the queue context */
 	qdma_descq_context_clear(descq->xdev, descq->qidx_hw,
 					descq->conf.st, descq->conf.q_type, 0);
+	qdma_descq_csr_slots_ref(descq, false);
 
 	/** if the device is in direct/indirect interrupt mode,
 	 *  delete the interrupt list for the queue
 	 */
 	if ((descq->xdev->conf.qdma_drv_mode != POLL_MODE) &&
-		(descq->xdev->conf.qdma_drv_mode != LEGACY_INTR_MODE)) {
-		unsigned long flags;
-		struct intr_info_t *dev_intr_info_list =
-			&descq->xdev->dev_intr_info_list[descq->intr_id];
+		(descq->xdev->conf.qdma_drv_mode != LEGACY_INTR_MODE))
+		intr_q_tbl_del(descq);
 
-		spin_lock_irqsave(&dev_intr_info_list->vec_q_list, flags);
-		list_del(&descq->intr_list);
-		dev_intr_info_list->intr_list_cnt--;
-		spin_unlock_irqrestore(&dev_intr_info_list->vec_q_list, flags);
-	}
+	/** make sure the deferred freelist refill is not running */
+	if (descq->conf.st && (descq->conf.q_type == Q_C2H))
+		qdma_wq_cancel_work_sync(&descq->xdev->dp_wq,
+					 &descq->flq_refill_work);
+	/** make sure the H2C completion timer is not running */
+	if (descq->conf.st && (descq->conf.q_type == Q_H2C))
+		hrtimer_cancel(&descq->h2c_irq_timer);
 
 	/** free the queue resources */
 	qdma_descq_free_resource(descq);
 	/** free the descq by updating the state */
 	descq->total_cmpl_descs = 0;
+	descq->c2h_cmpl_descs = 0;
 
 	/** fill the return buffer indicating that queue is stopped */
 	snprintf(buf, buflen, "queue %s, idx %u stopped.\n",
@@ -2151,18 +2238,18 @@ int qdma_intr_ring_dump(unsigned long dev_hndl, unsigned int vector_idx,
 	 */
 	if ((vector_idx < xdev->dvec_start_idx) ||
 		(vector_idx >=
-		(xdev->dvec_start_idx + QDMA_NUM_DATA_VEC_FOR_INTR_CXT))) {
+		(xdev->dvec_start_idx + xdev->intr_ring_cnt))) {
 		pr_err("Vector idx %u is invalid. Shall be in range: %d -  %d.\n",
 			vector_idx,
 			xdev->dvec_start_idx,
 			(xdev->dvec_start_idx +
-			QDMA_NUM_DATA_VEC_FOR_INTR_CXT - 1));
+			xdev->intr_ring_cnt - 1));
 		snprintf(buf, buflen,
 			"Vector idx %u is invalid. Shall be in range: %d -  %d.\n",
 			vector_idx,
 			xdev->dvec_start_idx,
 			(xdev->dvec_start_idx +
-			QDMA_NUM_DATA_VEC_FOR_INTR_CXT - 1));
+			xdev->intr_ring_cnt - 1));
 		return -EINVAL;
 	}
 
@@ -2454,8 +2541,12 @@ ssize_t qdma_request_submit(unsigned long dev_hndl, unsigned long id,
 		rv = -EINVAL;
 		goto unmap_sgl;
 	}
-	qdma_work_queue_add(descq, cb);
+	rv = qdma_work_queue_add(descq, cb);
 	unlock_descq(descq);
+	if (rv < 0) {
+		pr_debug("%s: work ring full.\n", descq->conf.name);
+		goto unmap_sgl;
+	}
 
 	pr_debug("%s: cb 0x%p submitted.\n", descq->conf.name, cb);
 
@@ -2599,15 +2690,25 @@ ssize_t qdma_batch_request_submit(unsigned long dev_hndl, unsigned long id,
 	}
 
 	for (i = 0; i < count; i++) {
-		req = reqv[i];
-		cb = qdma_req_cb_get(req);
-
-		list_add_tail(&cb->list, &descq->work_list);
+		cb = qdma_req_cb_get(reqv[i]);
+		if (qdma_work_queue_add(descq, cb) < 0)
+			break;
 	}
 	unlock_descq(descq);
 
 	qdma_descq_proc_sgt_request(descq);
 
+	/** the work ring is full, fail the rest of the batch */
+	for (; i < count; i++) {
+		req = reqv[i];
+		cb = qdma_req_cb_get(req);
+		if (cb->unmap_needed) {
+			sgl_unmap(xdev->conf.pdev, req->sgl, req->sgcnt, dir);
+			cb->unmap_needed = 0;
+		}
+		req->fp_done(req, 0, -EBUSY);
+	}
+
 	return 0;
 }
 
@@ -2634,11 +2735,24 @@ int libqdma_init(unsigned int num_threads, void *debugfs_root)
 			sizeof(struct qdma_sgt_req_cb), QDMA_REQ_OPAQUE_SIZE);
 		return -1;
 	}
-	if (sizeof(struct qdma_flq) > QDMA_FLQ_SIZE) {
-		pr_err("qdma flq data size too big %lu > %d",
-		       sizeof(struct qdma_flq), QDMA_FLQ_SIZE);
-		return -1;
-	}
+	BUILD_BUG_ON(sizeof(struct qdma_flq) > QDMA_FLQ_SIZE);
+
+	/** The fast paths touch one cache line of each section of
+	 *  struct qdma_descq, keep the hot sections within a line. The lock
+	 *  sections only fit without spinlock debugging.
+	 */
+	BUILD_BUG_ON(offsetofend(struct qdma_queue_conf, fp_descq_c2h_packet) >
+		     SMP_CACHE_BYTES);
+	BUILD_BUG_ON(offsetofend(struct qdma_descq, cmpt_entry_len) -
+		     offsetof(struct qdma_descq, xdev) > SMP_CACHE_BYTES);
+	BUILD_BUG_ON(sizeof(spinlock_t) <= sizeof(u32) &&
+		     offsetofend(struct qdma_descq, c2h_cmpl_descs) -
+		     offsetof(struct qdma_descq, lock) > SMP_CACHE_BYTES);
+	BUILD_BUG_ON(sizeof(spinlock_t) <= sizeof(u32) &&
+		     offsetofend(struct qdma_descq, total_cmpl_descs) -
+		     offsetof(struct qdma_descq, cmpl_lock) > SMP_CACHE_BYTES);
+	BUILD_BUG_ON(offsetofend(struct qdma_flq, pg_sdesc) >
+		     SMP_CACHE_BYTES);
 
 	/** Create the qdma threads */
 	ret = qdma_threads_create(num_threads);
@@ -39,6 +39,7 @@
 #include <linux/interrupt.h>
 #include "libqdma_config.h"
 #include "qdma_access_export.h"
+#include "qdma_access_common.h"
 
 
 /** @defgroup libqdma_enums Enumerations
@@ -417,8 +418,13 @@ struct qdma_dev_conf {
 	 * moderate interrupt generation
 	 */
 	u8 intr_moderation:1;
+	/**
+	 * run the queue work on an unbound workqueue, whose cpumask can
+	 * then be set in /sys/devices/virtual/workqueue
+	 */
+	u8 wq_unbound:1;
 	/** Reserved1 */
-	u8 rsvd1:5;
+	u8 rsvd1:4;
 	/**
 	 * Maximum number of virtual functions for
 	 * current physical function
@@ -449,6 +455,11 @@ struct qdma_dev_conf {
 	unsigned long uld;
 	/** qdma driver mode */
 	enum qdma_drv_mode qdma_drv_mode;
+	/**
+	 * poll mode only, time in usecs a completion status thread keeps
+	 * polling its idle queues before going to sleep
+	 */
+	unsigned int poll_spin_us;
 	/**
 	 * an unique string to identify the dev.
 	 * current format: qdma[pf|vf][idx] filled in by libqdma
@@ -651,6 +662,18 @@ struct qdma_queue_conf {
 	/**  MM Channel */
 	u8 mm_channel:1;
 
+	/** @note Following fields are filled by libqdma, they are read on
+	 *  every packet and kept in the first cache line with the handlers
+	 */
+	/**  Ping Pong measurement */
+	u8 ping_pong_en:1;
+	/**  ring size of the queue */
+	unsigned int rngsz;
+	/**  completion ring size of the queue */
+	unsigned int rngsz_cmpt;
+	/** C2H buffer size */
+	unsigned int c2h_bufsz;
+
 	/**  user provided per-Q irq handler */
 	unsigned long quld;		/* set by user for per Q data */
 	/**  acummulate PIDX to batch packets */
@@ -731,14 +754,6 @@ struct qdma_queue_conf {
 	/** @note Following fileds are filled by libqdma */
 	/**  name of the qdma device */
 	char name[QDMA_QUEUE_NAME_MAXLEN];
-	/**  ring size of the queue */
-	unsigned int rngsz;
-	/**  completion ring size of the queue */
-	unsigned int rngsz_cmpt;
-	/** C2H buffer size */
-	unsigned int c2h_bufsz;
-	/**  Ping Pong measurement */
-	u8 ping_pong_en:1;
 	/**  Keyhole Aperture Size */
 	u32 aperture_size;
 };
@@ -976,6 +991,41 @@ int qdma_device_get_config(unsigned long dev_hndl, struct qdma_dev_conf *conf,
  *****************************************************************************/
 int qdma_device_clear_stats(unsigned long dev_hndl);
 
+/**
+ * Deferred work statistics of a device workqueue
+ *
+ * @ingroup libqdma_struct
+ *
+ */
+struct qdma_wq_stats {
+	/**  # of work items queued */
+	u64 queued;
+	/**  # of work items run */
+	u64 run;
+	/**  # of work items queued but not run yet */
+	unsigned int depth;
+	/**  max. # of work items waiting to run */
+	unsigned int depth_max;
+	/**  average queue to run latency, in ns */
+	u64 lat_avg_ns;
+	/**  max. queue to run latency, in ns */
+	u64 lat_max_ns;
+};
+
+/*****************************************************************************/
+/**
+ * Retrieve the statistics of the device workqueues
+ *
+ * @param dev_hndl	dev_hndl retunred from qdma_device_open()
+ * @param dp		data path (queue work) workqueue statistics, can be NULL
+ * @param hk		housekeeping workqueue statistics, can be NULL
+ *
+ * @returns		0 for success and <0 for error
+ *
+ *****************************************************************************/
+int qdma_device_get_wq_stats(unsigned long dev_hndl,
+			struct qdma_wq_stats *dp, struct qdma_wq_stats *hk);
+
 /*****************************************************************************/
 /**
  * Get mm h2c packets processed
@@ -1218,6 +1268,43 @@ int qdma_software_version_info(char *software_version, int length);
 int qdma_global_csr_get(unsigned long dev_hndl, u8 index, u8 count,
 		struct global_csr_conf *csr);
 
+/*****************************************************************************/
+/**
+ * Take a reference on a global csr slot holding a value
+ *
+ * @param dev_hndl	handle returned from qdma_device_open()
+ * @param csr_type	global csr array
+ * @param value		value needed, the ring size excludes the wrap around
+ *			and status descriptors as in qdma_global_csr_get()
+ * @param index		slot index returned
+ *
+ * @returns		0 for success and <0 for error
+ *
+ * The 16 slots of each global csr array are shared by all the functions of
+ * the device. A slot already holding value is shared, otherwise a slot
+ * nobody holds a reference on is reprogrammed with value. A started queue,
+ * VF queues included, references the slots indexed by its configuration.
+ * -ENOSPC is returned when all the slots are referenced.
+ *
+ *****************************************************************************/
+int qdma_global_csr_slot_get(unsigned long dev_hndl,
+		enum qdma_global_csr_type csr_type, unsigned int value,
+		u8 *index);
+
+/*****************************************************************************/
+/**
+ * Drop a reference taken with qdma_global_csr_slot_get()
+ *
+ * @param dev_hndl	handle returned from qdma_device_open()
+ * @param csr_type	global csr array
+ * @param index		slot index
+ *
+ * @returns		0 for success and <0 for error
+ *
+ *****************************************************************************/
+int qdma_global_csr_slot_put(unsigned long dev_hndl,
+		enum qdma_global_csr_type csr_type, u8 index);
+
 /*****************************************************************************/
 /**
  * Add a queue
@@ -1294,6 +1381,20 @@ int qdma_queue_stop(unsigned long dev_hndl, unsigned long id, char *buf,
 int qdma_get_queue_state(unsigned long dev_hndl, unsigned long id,
 		struct qdma_q_state *q_state, char *buf, int buflen);
 
+/*****************************************************************************/
+/**
+ * Get the Linux irq number of the MSI-X vector serving the queue, in
+ * indirect interrupt mode the vector of the queue's aggregation ring
+ *
+ * @param dev_hndl	dev_hndl returned from qdma_device_open()
+ * @param id		the opaque qhndl
+ *
+ * @returns		irq number for success and <0 for error, e.g. in poll
+ *			or legacy interrupt mode
+ *
+ *****************************************************************************/
+int qdma_queue_get_irq(unsigned long dev_hndl, unsigned long id);
+
 /*****************************************************************************/
 /**
  * remove a queue
@@ -1508,6 +1609,27 @@ int qdma_queue_avail_desc(unsigned long dev_hndl, unsigned long id);
 int qdma_queue_cmpl_ctrl(unsigned long dev_hndl, unsigned long id,
 				struct qdma_cmpl_ctrl *cctrl, bool set);
 
+/*****************************************************************************/
+/**
+ * Set the interrupt moderation of a ST H2C queue
+ *
+ * @param dev_hndl	hndl returned from qdma_device_open()
+ * @param id		hndl returned from qdma_queue_add()
+ * @param frames	outstanding descriptors arming the completion interrupt,
+ *			0 or 1 arm it with every pidx update
+ * @param usecs		delay after which the queue is serviced while its
+ *			interrupt is not armed
+ *
+ * @returns		0 for success or <0 for error
+ *
+ * The status writeback interval is a global setting, see
+ * qdma_set_cmpl_status_acc(). This controls when the writebacks of the queue
+ * raise an interrupt.
+ *
+ *****************************************************************************/
+int qdma_queue_h2c_irq_moder(unsigned long dev_hndl, unsigned long id,
+			unsigned int frames, unsigned int usecs);
+
 /*****************************************************************************/
 /**
  * Read rcv'ed data (ST C2H dma operation)
@@ -1567,6 +1689,145 @@ int qdma_queue_service(unsigned long dev_hndl, unsigned long id,
  *****************************************************************************/
 int qdma_queue_update_pointers(unsigned long dev_hndl, unsigned long qhndl);
 
+/*****************************************************************************/
+/**
+ * Update queue pointers and optionally leave the completion interrupt masked
+ *
+ * @param dev_hndl	dev_hndl returned from qdma_device_open()
+ * @param qhndl		hndl returned from qdma_queue_add()
+ * @param irq_arm	false to keep the completion interrupt disabled, e.g.
+ *			when napi_complete_done() reports that the queue is
+ *			still owned by a busy poller or deferred hard irqs
+ *
+ * Return:	0 for success or <0 for error
+ *
+ *****************************************************************************/
+int qdma_queue_update_pointers_irq(unsigned long dev_hndl,
+				   unsigned long qhndl, bool irq_arm);
+
+/**
+ * Result of a single pass ST C2H queue service
+ *
+ * @ingroup libqdma_struct
+ *
+ */
+struct qdma_c2h_service_stat {
+	/**  # of completion entries processed */
+	unsigned int processed;
+	/**  # of completion entries left in the ring */
+	unsigned int pending;
+	/**  ring drained within the budget, the completion interrupt can be
+	 *   re-armed once the caller gives up the queue
+	 */
+	bool irq_arm;
+};
+
+/*****************************************************************************/
+/**
+ * Service a ST C2H queue in a single pass: process the completion ring,
+ * refill the freelist and update the cidx/pidx under one queue lock
+ * acquisition. The completion interrupt is left masked, stat->irq_arm tells
+ * whether the caller may re-arm it with qdma_queue_update_pointers_irq()
+ * after completing its polling context.
+ *
+ * @param dev_hndl	dev_hndl returned from qdma_device_open()
+ * @param qhndl		hndl returned from qdma_queue_add()
+ * @param budget	max number of completions to be processed
+ * @param stat		filled in by libqdma, may be NULL
+ *
+ * Return:	0 for success or <0 for error
+ *
+ *****************************************************************************/
+int qdma_queue_c2h_service(unsigned long dev_hndl, unsigned long qhndl,
+			   int budget, struct qdma_c2h_service_stat *stat);
+
+/** fast path interfaces  */
+
+struct qdma_descq;
+
+/*****************************************************************************/
+/**
+ * Resolve the fast path handle of a queue once, after qdma_queue_add().
+ * The *_fp() variants below take it directly and skip the per call dev_hndl
+ * and queue id validation, which only debug builds keep doing.
+ * The handle is valid until qdma_queue_remove().
+ *
+ * @param dev_hndl	dev_hndl returned from qdma_device_open()
+ * @param qhndl		hndl returned from qdma_queue_add()
+ *
+ * Return:	fast path handle or NULL for error
+ *
+ *****************************************************************************/
+struct qdma_descq *qdma_queue_fp_hndl(unsigned long dev_hndl,
+				      unsigned long qhndl);
+
+/*****************************************************************************/
+/**
+ * qdma_queue_packet_write() on a fast path handle
+ *
+ * @param descq		handle returned from qdma_queue_fp_hndl()
+ * @param req		pointer to the list of packet data
+ *
+ * Return:	# of bytes transferred for success and  <0 for error
+ *
+ *****************************************************************************/
+int qdma_queue_packet_write_fp(struct qdma_descq *descq,
+			       struct qdma_request *req);
+
+/*****************************************************************************/
+/**
+ * Query the # of requests qdma_queue_packet_write_fp() can still queue,
+ * without taking the queue lock. The value may be stale by the time it is
+ * used, the submit itself returns -EBUSY when the request ring is full.
+ *
+ * @param descq		handle returned from qdma_queue_fp_hndl()
+ *
+ * Return:	# of free request ring entries or <0 for error
+ *
+ *****************************************************************************/
+int qdma_queue_write_room_fp(struct qdma_descq *descq);
+
+/*****************************************************************************/
+/**
+ * qdma_queue_service() on a fast path handle
+ *
+ * @param descq		handle returned from qdma_queue_fp_hndl()
+ * @param budget	ST C2H only, max number of completions to be processed.
+ * @param c2h_upd_cmpl	flag to update the completion
+ *
+ * Return:	0 for success or <0 for error
+ *
+ *****************************************************************************/
+int qdma_queue_service_fp(struct qdma_descq *descq, int budget,
+			  bool c2h_upd_cmpl);
+
+/*****************************************************************************/
+/**
+ * qdma_queue_c2h_service() on a fast path handle, the completion interrupt
+ * is re-armed with qdma_queue_c2h_irq_arm_fp()
+ *
+ * @param descq		handle returned from qdma_queue_fp_hndl()
+ * @param budget	max number of completions to be processed
+ * @param stat		filled in by libqdma, may be NULL
+ *
+ * Return:	0 for success or <0 for error
+ *
+ *****************************************************************************/
+int qdma_queue_c2h_service_fp(struct qdma_descq *descq, int budget,
+			      struct qdma_c2h_service_stat *stat);
+
+/*****************************************************************************/
+/**
+ * Re-arm the completion interrupt of a ST C2H queue serviced with
+ * qdma_queue_c2h_service_fp(), without touching the freelist pidx
+ *
+ * @param descq		handle returned from qdma_queue_fp_hndl()
+ *
+ * Return:	0 for success or <0 for error
+ *
+ *****************************************************************************/
+int qdma_queue_c2h_irq_arm_fp(struct qdma_descq *descq);
+
 /*****************************************************************************/
 /**
  * Display the interrupt ring info of a vector
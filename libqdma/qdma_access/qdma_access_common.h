@@ -94,6 +94,16 @@ static inline uint32_t get_trailing_zeros(uint64_t value)
  */
 #define QDMA_NUM_DATA_VEC_FOR_INTR_CXT  1
 
+/** Maximum data vectors, each with its own interrupt aggregation ring, of a
+ * PF in indirect interrupt mode. The rings past the first
+ * QDMA_NUM_DATA_VEC_FOR_INTR_CXT of a function are indexed after those of
+ * all QDMA_INTR_RING_FUNC_MAX functions, so functions sticking to
+ * QDMA_NUM_DATA_VEC_FOR_INTR_CXT rings keep their ring index. VFs program
+ * their rings through the mailbox and stay at QDMA_NUM_DATA_VEC_FOR_INTR_CXT.
+ */
+#define QDMA_NUM_DATA_VEC_FOR_INTR_MAX  8
+#define QDMA_INTR_RING_FUNC_MAX         256
+
 enum ind_ctxt_cmd_op {
 	QDMA_CTXT_CMD_CLR,
 	QDMA_CTXT_CMD_WR,
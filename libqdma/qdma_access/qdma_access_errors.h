@@ -63,6 +63,8 @@ enum qdma_access_error_codes {
 	QDMA_ERR_MBOX_NO_MSG_IN,
 	QDMA_ERR_MBOX_REG_READ_FAILED,
 	QDMA_ERR_MBOX_ALL_ZERO_MSG,			/* 25 */
+
+	QDMA_ERR_RM_NO_CSR_SLOT_LEFT,		/* 26 */
 };
 
 #ifdef __cplusplus
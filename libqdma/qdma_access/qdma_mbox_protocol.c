@@ -629,6 +629,69 @@ static int mbox_compose_cmpt_context(void *dev_hndl,
 	return QDMA_SUCCESS;
 }
 
+/*
+ * mbox_csr_slots_ref() - take or drop the references of a VF queue on the
+ *	global csr slots used by its valid contexts, the PF then does not
+ *	reprogram them under the queue. The VF moves the completion timer and
+ *	counter threshold indexes with its cidx writes, the queue references
+ *	all the slots of those arrays.
+ */
+static void mbox_csr_slots_ref(uint8_t dma_device_index, uint16_t func_id,
+			       struct qdma_descq_context *ctxt, uint8_t hold)
+{
+	int (*ref)(uint32_t, uint16_t, enum qdma_global_csr_type, uint8_t) =
+		hold ? qdma_dev_csr_slot_hold : qdma_dev_csr_slot_put;
+
+	if (ctxt->sw_ctxt.qen)
+		ref(dma_device_index, func_id, QDMA_CSR_RING_SZ,
+		    ctxt->sw_ctxt.rngsz_idx);
+	if (ctxt->pfetch_ctxt.valid)
+		ref(dma_device_index, func_id, QDMA_CSR_BUF_SZ,
+		    ctxt->pfetch_ctxt.bufsz_idx);
+	if (ctxt->cmpt_ctxt.valid) {
+		ref(dma_device_index, func_id, QDMA_CSR_RING_SZ,
+		    ctxt->cmpt_ctxt.ringsz_idx);
+		ref(dma_device_index, func_id, QDMA_CSR_TIMER_CNT,
+		    QDMA_CSR_SLOT_ANY);
+		ref(dma_device_index, func_id, QDMA_CSR_CNT_TH,
+		    QDMA_CSR_SLOT_ANY);
+	}
+}
+
+/*
+ * mbox_csr_slots_release() - drop the csr slot references of a VF queue
+ *	whose contexts are still valid, before they are cleared or invalidated
+ */
+static void mbox_csr_slots_release(void *dev_hndl, uint8_t dma_device_index,
+			uint16_t func_id, uint16_t qid_hw, uint8_t st,
+			uint8_t c2h, enum mbox_cmpt_ctxt_type cmpt_ctxt_type)
+{
+	struct qdma_descq_context ctxt;
+	struct qdma_hw_access *hw = NULL;
+
+	qdma_get_hw_access(dev_hndl, &hw);
+	qdma_mbox_memset(&ctxt, 0, sizeof(struct qdma_descq_context));
+
+	if (cmpt_ctxt_type != QDMA_MBOX_CMPT_CTXT_ONLY) {
+		if (hw->qdma_sw_ctx_conf(dev_hndl, c2h, qid_hw,
+					 &ctxt.sw_ctxt,
+					 QDMA_HW_ACCESS_READ) < 0)
+			ctxt.sw_ctxt.qen = 0;
+		if (st && c2h &&
+		    hw->qdma_pfetch_ctx_conf(dev_hndl, qid_hw,
+					     &ctxt.pfetch_ctxt,
+					     QDMA_HW_ACCESS_READ) < 0)
+			ctxt.pfetch_ctxt.valid = 0;
+	}
+
+	if (cmpt_ctxt_type != QDMA_MBOX_CMPT_CTXT_NONE &&
+	    hw->qdma_cmpt_ctx_conf(dev_hndl, qid_hw, &ctxt.cmpt_ctxt,
+				   QDMA_HW_ACCESS_READ) < 0)
+		ctxt.cmpt_ctxt.valid = 0;
+
+	mbox_csr_slots_ref(dma_device_index, func_id, &ctxt, 0);
+}
+
 static int mbox_clear_queue_contexts(void *dev_hndl, uint8_t dma_device_index,
 			      uint16_t func_id, uint16_t qid_hw, uint8_t st,
 			      uint8_t c2h,
@@ -643,6 +706,8 @@ static int mbox_clear_queue_contexts(void *dev_hndl, uint8_t dma_device_index,
 	qdma_get_hw_access(dev_hndl, &hw);
 
 	if (cmpt_ctxt_type == QDMA_MBOX_CMPT_CTXT_ONLY) {
+		mbox_csr_slots_release(dev_hndl, dma_device_index, func_id,
+				       qid_hw, st, c2h, cmpt_ctxt_type);
 		rv = hw->qdma_cmpt_ctx_conf(dev_hndl, qid_hw,
 					    NULL, QDMA_HW_ACCESS_CLEAR);
 		if (rv < 0) {
@@ -667,6 +732,8 @@ static int mbox_clear_queue_contexts(void *dev_hndl, uint8_t dma_device_index,
 			return rv;
 		}
 
+		mbox_csr_slots_release(dev_hndl, dma_device_index, func_id,
+				       qid_hw, st, c2h, cmpt_ctxt_type);
 		rv = hw->qdma_sw_ctx_conf(dev_hndl, c2h, qid_hw,
 					  NULL, QDMA_HW_ACCESS_CLEAR);
 		if (rv < 0) {
@@ -732,6 +799,8 @@ static int mbox_invalidate_queue_contexts(void *dev_hndl,
 	qdma_get_hw_access(dev_hndl, &hw);
 
 	if (cmpt_ctxt_type == QDMA_MBOX_CMPT_CTXT_ONLY) {
+		mbox_csr_slots_release(dev_hndl, dma_device_index, func_id,
+				       qid_hw, st, c2h, cmpt_ctxt_type);
 		rv = hw->qdma_cmpt_ctx_conf(dev_hndl, qid_hw, NULL,
 					    QDMA_HW_ACCESS_INVALIDATE);
 		if (rv < 0) {
@@ -756,6 +825,8 @@ static int mbox_invalidate_queue_contexts(void *dev_hndl,
 			return rv;
 		}
 
+		mbox_csr_slots_release(dev_hndl, dma_device_index, func_id,
+				       qid_hw, st, c2h, cmpt_ctxt_type);
 		rv = hw->qdma_sw_ctx_conf(dev_hndl, c2h, qid_hw,
 					  NULL, QDMA_HW_ACCESS_INVALIDATE);
 		if (rv < 0) {
@@ -842,6 +913,10 @@ static int mbox_write_queue_contexts(void *dev_hndl, uint8_t dma_device_index,
 		if (rv < 0)
 			return rv;
 
+		mbox_csr_slots_release(dev_hndl, dma_device_index,
+				       qctxt->descq_conf.func_id, qid_hw,
+				       qctxt->st, qctxt->c2h,
+				       qctxt->cmpt_ctxt_type);
 		rv = hw->qdma_cmpt_ctx_conf(dev_hndl, qid_hw,
 					    NULL, QDMA_HW_ACCESS_CLEAR);
 		if (rv < 0) {
@@ -919,6 +994,10 @@ static int mbox_write_queue_contexts(void *dev_hndl, uint8_t dma_device_index,
 			}
 		}
 	}
+
+	mbox_csr_slots_ref(dma_device_index, qctxt->descq_conf.func_id,
+			   &descq_ctxt, 1);
+
 	return QDMA_SUCCESS;
 }
 
@@ -24,7 +24,7 @@ extern "C" {
 #include "qdma_platform_env.h"
 #include "qdma_access_common.h"
 
-#define DEBUGFS_DEV_INFO_SZ		(300)
+#define DEBUGFS_DEV_INFO_SZ		(640)
 
 #define QDMA_REG_NAME_LENGTH	64
 #define DEBUGFS_INTR_CNTX_SZ	(2048 * 2)
@@ -35,6 +35,10 @@ struct qdma_dev_entry {
 	uint32_t active_h2c_qcnt;
 	uint32_t active_c2h_qcnt;
 	uint32_t active_cmpt_qcnt;
+	/** references of the function on each global csr slot */
+	uint16_t csr_slot_refcnt[QDMA_CSR_MAX][QDMA_GLOBAL_CSR_ARRAY_SZ];
+	/** references of the function on all the slots of a csr array */
+	uint16_t csr_any_refcnt[QDMA_CSR_MAX];
 	struct qdma_resource_entry entry;
 };
 
@@ -792,3 +796,140 @@ int qdma_get_device_active_queue_count(uint32_t dma_device_index,
 
 	return dev_active_qcnt;
 }
+
+/* a slot is busy while any function references it or all the slots of its
+ * array, called with the resource lock held
+ */
+static int qdma_csr_slot_busy(struct qdma_resource_master *q_resource,
+		enum qdma_global_csr_type csr_type, int slot)
+{
+	struct qdma_list_head *entry, *tmp;
+
+	qdma_list_for_each_safe(entry, tmp, &q_resource->dev_list) {
+		struct qdma_dev_entry *dev_entry = (struct qdma_dev_entry *)
+			QDMA_LIST_GET_DATA(entry);
+
+		if (dev_entry->csr_any_refcnt[csr_type] ||
+		    (slot < QDMA_GLOBAL_CSR_ARRAY_SZ &&
+		     dev_entry->csr_slot_refcnt[csr_type][slot]))
+			return 1;
+	}
+
+	return 0;
+}
+
+int qdma_dev_csr_slot_get(uint32_t dma_device_index, uint16_t func_id,
+		enum qdma_global_csr_type csr_type, const uint32_t *hw_values,
+		uint32_t value, uint8_t *slot)
+{
+	struct qdma_resource_master *q_resource =
+			qdma_get_master_resource_entry(dma_device_index);
+	struct qdma_dev_entry *dev_entry;
+	int i, free_slot = -1;
+
+	if (!q_resource)
+		return -QDMA_ERR_RM_RES_NOT_EXISTS;
+
+	if (csr_type >= QDMA_CSR_MAX || !hw_values || !slot)
+		return -QDMA_ERR_INV_PARAM;
+
+	dev_entry = qdma_get_dev_entry(dma_device_index, func_id);
+	if (!dev_entry)
+		return -QDMA_ERR_RM_DEV_NOT_EXISTS;
+
+	qdma_resource_lock_take();
+	/* reuse a slot with the value, in use or not */
+	for (i = 0; i < QDMA_GLOBAL_CSR_ARRAY_SZ; i++) {
+		if (hw_values[i] == value) {
+			dev_entry->csr_slot_refcnt[csr_type][i]++;
+			*slot = i;
+			qdma_resource_lock_give();
+			return 0;
+		}
+		if (free_slot < 0 &&
+		    !qdma_csr_slot_busy(q_resource, csr_type, i))
+			free_slot = i;
+	}
+
+	if (free_slot < 0) {
+		qdma_resource_lock_give();
+		qdma_log_error("%s: no free csr %d slot for %u, err:%d\n",
+				__func__, csr_type, value,
+				-QDMA_ERR_RM_NO_CSR_SLOT_LEFT);
+		return -QDMA_ERR_RM_NO_CSR_SLOT_LEFT;
+	}
+
+	dev_entry->csr_slot_refcnt[csr_type][free_slot]++;
+	*slot = free_slot;
+	qdma_resource_lock_give();
+
+	return 1;
+}
+
+int qdma_dev_csr_slot_hold(uint32_t dma_device_index, uint16_t func_id,
+		enum qdma_global_csr_type csr_type, uint8_t slot)
+{
+	struct qdma_dev_entry *dev_entry;
+
+	if (csr_type >= QDMA_CSR_MAX || slot > QDMA_CSR_SLOT_ANY)
+		return -QDMA_ERR_INV_PARAM;
+
+	dev_entry = qdma_get_dev_entry(dma_device_index, func_id);
+	if (!dev_entry)
+		return -QDMA_ERR_RM_DEV_NOT_EXISTS;
+
+	qdma_resource_lock_take();
+	if (slot == QDMA_CSR_SLOT_ANY)
+		dev_entry->csr_any_refcnt[csr_type]++;
+	else
+		dev_entry->csr_slot_refcnt[csr_type][slot]++;
+	qdma_resource_lock_give();
+
+	return QDMA_SUCCESS;
+}
+
+int qdma_dev_csr_slot_put(uint32_t dma_device_index, uint16_t func_id,
+		enum qdma_global_csr_type csr_type, uint8_t slot)
+{
+	struct qdma_dev_entry *dev_entry;
+	uint16_t *refcnt;
+	int rv = QDMA_SUCCESS;
+
+	if (csr_type >= QDMA_CSR_MAX || slot > QDMA_CSR_SLOT_ANY)
+		return -QDMA_ERR_INV_PARAM;
+
+	dev_entry = qdma_get_dev_entry(dma_device_index, func_id);
+	if (!dev_entry)
+		return -QDMA_ERR_RM_DEV_NOT_EXISTS;
+
+	qdma_resource_lock_take();
+	if (slot == QDMA_CSR_SLOT_ANY)
+		refcnt = &dev_entry->csr_any_refcnt[csr_type];
+	else
+		refcnt = &dev_entry->csr_slot_refcnt[csr_type][slot];
+	if (*refcnt)
+		(*refcnt)--;
+	else
+		rv = -QDMA_ERR_INV_PARAM;
+	qdma_resource_lock_give();
+
+	return rv;
+}
+
+int qdma_dev_csr_slots_in_use(uint32_t dma_device_index)
+{
+	struct qdma_resource_master *q_resource =
+			qdma_get_master_resource_entry(dma_device_index);
+	int csr_type, i, in_use = 0;
+
+	if (!q_resource)
+		return 0;
+
+	qdma_resource_lock_take();
+	for (csr_type = 0; csr_type < QDMA_CSR_MAX && !in_use; csr_type++)
+		for (i = 0; i <= QDMA_CSR_SLOT_ANY && !in_use; i++)
+			in_use = qdma_csr_slot_busy(q_resource, csr_type, i);
+	qdma_resource_lock_give();
+
+	return in_use;
+}
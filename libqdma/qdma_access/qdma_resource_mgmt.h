@@ -30,6 +30,7 @@ extern "C" {
 
 #include "qdma_platform_env.h"
 #include "qdma_access_export.h"
+#include "qdma_access_common.h"
 
 /**
  * enum qdma_dev_q_range: Q ranage check
@@ -206,6 +207,78 @@ int qdma_get_device_active_queue_count(uint32_t dma_device_index,
 					uint16_t func_id,
 					enum qdma_dev_q_type q_type);
 
+/** slot index standing for all the slots of a global csr array */
+#define QDMA_CSR_SLOT_ANY	QDMA_GLOBAL_CSR_ARRAY_SZ
+
+/*****************************************************************************/
+/**
+ * qdma_dev_csr_slot_get(): take a reference on a global csr slot holding
+ *				value, or on a free slot to be programmed
+ *
+ * @dma_device_index: DMA device identifier
+ * @func_id:     function taking the reference
+ * @csr_type:    global csr array
+ * @hw_values:   the array as currently read from the hardware
+ * @value:       value requested, in hardware units
+ * @slot:        slot index returned
+ *
+ * The slots are shared by all the functions of the device. A slot is free
+ * when no function references it, the references of started queues
+ * included. The caller must serialize the calls with the programming of
+ * newly assigned slots.
+ *
+ * Return:	0  : a slot already holds value
+ *		1  : a free slot is assigned, the caller programs value in it
+ *		< 0: failure
+ *****************************************************************************/
+int qdma_dev_csr_slot_get(uint32_t dma_device_index, uint16_t func_id,
+		enum qdma_global_csr_type csr_type, const uint32_t *hw_values,
+		uint32_t value, uint8_t *slot);
+
+/*****************************************************************************/
+/**
+ * qdma_dev_csr_slot_hold(): take a reference on a global csr slot used by
+ *				a queue context
+ *
+ * @dma_device_index: DMA device identifier
+ * @func_id:     function the queue belongs to
+ * @csr_type:    global csr array
+ * @slot:        slot index, QDMA_CSR_SLOT_ANY when the queue may move to
+ *		 any slot of the array at run time
+ *
+ * Return:	0  : success and < 0: failure
+ *****************************************************************************/
+int qdma_dev_csr_slot_hold(uint32_t dma_device_index, uint16_t func_id,
+		enum qdma_global_csr_type csr_type, uint8_t slot);
+
+/*****************************************************************************/
+/**
+ * qdma_dev_csr_slot_put(): drop a reference taken with
+ *				qdma_dev_csr_slot_get() or
+ *				qdma_dev_csr_slot_hold()
+ *
+ * @dma_device_index: DMA device identifier
+ * @func_id:     function holding the reference
+ * @csr_type:    global csr array
+ * @slot:        slot index or QDMA_CSR_SLOT_ANY
+ *
+ * Return:	0  : success and < 0: failure
+ *****************************************************************************/
+int qdma_dev_csr_slot_put(uint32_t dma_device_index, uint16_t func_id,
+		enum qdma_global_csr_type csr_type, uint8_t slot);
+
+/*****************************************************************************/
+/**
+ * qdma_dev_csr_slots_in_use(): check for references on the global csr slots
+ *
+ * @dma_device_index: DMA device identifier
+ *
+ * The references of a function go away with its device entry.
+ *
+ * Return:	1 if any function references a slot, 0 otherwise
+ *****************************************************************************/
+int qdma_dev_csr_slots_in_use(uint32_t dma_device_index);
+
 #ifdef __cplusplus
 }
 #endif
@@ -46,7 +46,7 @@ static int make_intr_context(struct xlnx_dma_dev *xdev,
 	/** program the coalescing context
 	 *  i -> Number of vectors
 	 */
-	for (i = 0; i <  QDMA_NUM_DATA_VEC_FOR_INTR_CXT; i++) {
+	for (i = 0; i < xdev->intr_ring_cnt; i++) {
 		struct intr_coal_conf *entry = (xdev->intr_coal_list + i);
 
 		ctxt[i].valid = 1;
@@ -243,9 +243,9 @@ int qdma_intr_context_setup(struct xlnx_dma_dev *xdev)
 
 	memset(&ictxt, 0, sizeof(struct mbox_msg_intr_ctxt));
 
-	ictxt.num_rings = QDMA_NUM_DATA_VEC_FOR_INTR_CXT;
+	ictxt.num_rings = xdev->intr_ring_cnt;
 
-	for (i = 0; i < QDMA_NUM_DATA_VEC_FOR_INTR_CXT; i++) {
+	for (i = 0; i < xdev->intr_ring_cnt; i++) {
 		ictxt.ring_index_list[i] =
 			get_intr_ring_index(xdev, xdev->dvec_start_idx + i);
 	}
@@ -522,7 +522,7 @@ int qdma_descq_context_dump(struct qdma_descq *descq, char *buf, int buflen)
 	if ((descq->xdev->conf.qdma_drv_mode == INDIRECT_INTR_MODE) ||
 			(descq->xdev->conf.qdma_drv_mode == AUTO_MODE)) {
 		for (ring_count = 0;
-				ring_count < QDMA_NUM_DATA_VEC_FOR_INTR_CXT;
+				ring_count < descq->xdev->intr_ring_cnt;
 				ring_count++) {
 			ring_index = get_intr_ring_index(
 						descq->xdev,
@@ -580,7 +580,7 @@ int qdma_prog_intr_context(struct xlnx_dma_dev *xdev,
 
 int qdma_intr_context_setup(struct xlnx_dma_dev *xdev)
 {
-	struct qdma_indirect_intr_ctxt ctxt[QDMA_NUM_DATA_VEC_FOR_INTR_CXT];
+	struct qdma_indirect_intr_ctxt ctxt[QDMA_NUM_DATA_VEC_FOR_INTR_MAX];
 	int i = 0;
 	int rv;
 	int ring_index;
@@ -589,8 +589,7 @@ int qdma_intr_context_setup(struct xlnx_dma_dev *xdev)
 			(xdev->conf.qdma_drv_mode != AUTO_MODE))
 		return 0;
 
-	memset(ctxt, 0, sizeof(struct qdma_indirect_intr_ctxt) *
-	       QDMA_NUM_DATA_VEC_FOR_INTR_CXT);
+	memset(ctxt, 0, sizeof(ctxt));
 	/** Preparing the interrupt context for all the vectors
 	 *  each vector's context width is QDMA_REG_IND_CTXT_WCNT_3(3)
 	 */
@@ -598,7 +597,7 @@ int qdma_intr_context_setup(struct xlnx_dma_dev *xdev)
 	if (rv < 0)
 		return rv;
 
-	for (i = 0; i <  QDMA_NUM_DATA_VEC_FOR_INTR_CXT; i++) {
+	for (i = 0; i < xdev->intr_ring_cnt; i++) {
 		ring_index = get_intr_ring_index(xdev,
 				(i + xdev->dvec_start_idx));
 		rv = xdev->hw.qdma_indirect_intr_ctx_conf(xdev, ring_index,
@@ -907,7 +906,7 @@ int qdma_descq_context_dump(struct qdma_descq *descq, char *buf, int buflen)
 	if ((descq->xdev->conf.qdma_drv_mode == INDIRECT_INTR_MODE) ||
 			(descq->xdev->conf.qdma_drv_mode == AUTO_MODE)) {
 		for (ring_count = 0;
-				ring_count < QDMA_NUM_DATA_VEC_FOR_INTR_CXT;
+				ring_count < descq->xdev->intr_ring_cnt;
 				ring_count++) {
 			ring_index = get_intr_ring_index(
 						descq->xdev,
@@ -27,6 +27,8 @@
 #include "qdma_context.h"
 #include "libqdma_export.h"
 #include "qdma_intr.h"
+#include "qdma_device.h"
+#include "qdma_thread.h"
 #include <linux/fs.h>
 #include <linux/uaccess.h>
 #include <linux/mutex.h>
@@ -36,6 +38,7 @@ enum dbgfs_dev_dbg_file_type {
 	DBGFS_DEV_DBGF_INFO = 0,
 	DBGFS_DEV_DBGF_REGS = 1,
 	DBGFS_DEV_DBGF_REG_INFO = 2,
+	DBGFS_DEV_DBGF_CPU_MAP = 3,
 	DBGFS_DEV_DBGF_END,
 };
 
@@ -260,6 +263,7 @@ static int dbgfs_dump_qdma_info(unsigned long dev_hndl, char *dev_name,
 	int buflen = DEBUGFS_DEV_INFO_SZ;
 	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
 	struct qdma_dev_conf *conf = NULL;
+	struct qdma_wq_stats wq_stats;
 
 	if (!xdev)
 		return -EINVAL;
@@ -288,6 +292,90 @@ static int dbgfs_dump_qdma_info(unsigned long dev_hndl, char *dev_name,
 			"Driver Mode",
 			mode_name_list[conf->qdma_drv_mode].name);
 
+	qdma_wq_stats_get(&xdev->dp_wq, &wq_stats);
+	len += snprintf(buf + len, buflen - len,
+			"%-36s: queued %llu run %llu depth %u/%u lat %llu/%llu ns\n",
+			"Data Path Workqueue", wq_stats.queued, wq_stats.run,
+			wq_stats.depth, wq_stats.depth_max,
+			wq_stats.lat_avg_ns, wq_stats.lat_max_ns);
+	qdma_wq_stats_get(&xdev->hk_wq, &wq_stats);
+	len += snprintf(buf + len, buflen - len,
+			"%-36s: queued %llu run %llu depth %u/%u\n",
+			"Housekeeping Workqueue", wq_stats.queued, wq_stats.run,
+			wq_stats.depth, wq_stats.depth_max);
+
+	*data = buf;
+	*data_len = buflen;
+
+	return len;
+}
+
+/*****************************************************************************/
+/**
+ * dbgfs_dump_cpu_map() - static function to dump the cpus the interrupt
+ *			  work of the device queues is bound to
+ *
+ * @param[in]	dev_hndl:	device handle
+ * @param[in]	dev_name:	device name
+ * @param[out]	data:		buffer holding the dump
+ * @param[out]	data_len:	size of the buffer
+ *
+ * @return	>=0: length of the dump
+ * @return	<0: error
+ *****************************************************************************/
+static int dbgfs_dump_cpu_map(unsigned long dev_hndl, char *dev_name,
+		char **data, int *data_len)
+{
+	int len = 0;
+	char *buf = NULL;
+	int buflen;
+	int cpu, i;
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_dev *qdev;
+
+	if (!xdev)
+		return -EINVAL;
+
+	if (xdev_check_hndl(__func__, xdev->conf.pdev, dev_hndl) < 0)
+		return -EINVAL;
+
+	qdev = xdev_2_qdev(xdev);
+	if (!qdev)
+		return -EINVAL;
+
+	buflen = num_online_cpus() * 64 + qdev->qmax * 2 * 16 + 64;
+
+	/** allocate memory */
+	buf = (char *) kzalloc(buflen, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	len += snprintf(buf + len, buflen - len, "%-16s: %d\n", "Device Node",
+			dev_to_node(&xdev->conf.pdev->dev));
+
+	for_each_online_cpu(cpu) {
+		len += snprintf(buf + len, buflen - len,
+				"cpu %-4d node %-2d qcnt %-4u:", cpu,
+				cpu_to_node(cpu), qdma_thread_cpu_qcnt(cpu));
+
+		for (i = 0; i < qdev->qmax; i++) {
+			struct qdma_descq *descq = &qdev->h2c_descq[i];
+
+			if (descq->cpu_assigned && descq->intr_work_cpu == cpu)
+				len += snprintf(buf + len, buflen - len,
+						" H2C%u", descq->qidx_hw);
+			descq = &qdev->c2h_descq[i];
+			if (descq->cpu_assigned && descq->intr_work_cpu == cpu)
+				len += snprintf(buf + len, buflen - len,
+						" C2H%u", descq->qidx_hw);
+		}
+		len += snprintf(buf + len, buflen - len, "\n");
+		if (len >= buflen) {
+			len = buflen - 1;
+			break;
+		}
+	}
+
 	*data = buf;
 	*data_len = buflen;
 
@@ -329,7 +417,7 @@ static int dbgfs_dump_intr_cntx(unsigned long dev_hndl, char *dev_name,
 	 */
 	if ((xdev->conf.qdma_drv_mode == INDIRECT_INTR_MODE) ||
 			(xdev->conf.qdma_drv_mode == AUTO_MODE)) {
-		for (i = 0; i < QDMA_NUM_DATA_VEC_FOR_INTR_CXT; i++) {
+		for (i = 0; i < xdev->intr_ring_cnt; i++) {
 			ring_index = get_intr_ring_index(
 						xdev,
 						(i + xdev->dvec_start_idx));
@@ -522,6 +610,9 @@ static ssize_t dev_dbg_file_read(struct file *fp, char __user *user_buffer,
 		} else if (type == DBGFS_DEV_DBGF_REG_INFO) {
 			rv = dbgfs_dump_qdma_reg_info(dev_priv->dev_hndl,
 					dev_priv->dev_name, &buf, &buf_len);
+		} else if (type == DBGFS_DEV_DBGF_CPU_MAP) {
+			rv = dbgfs_dump_cpu_map(dev_priv->dev_hndl,
+					dev_priv->dev_name, &buf, &buf_len);
 		}
 
 		if (rv < 0)
@@ -735,6 +826,40 @@ static ssize_t dev_reg_info_read(struct file *fp, char __user *user_buffer,
 	return dev_dbg_file_read(fp, user_buffer, count, ppos,
 			DBGFS_DEV_DBGF_REG_INFO);
 }
+
+/*****************************************************************************/
+/**
+ * dev_cpu_map_open() - static function that opens cpu map debug file
+ *
+ * @param[in]	inode:	pointer to file inode
+ * @param[in]	fp:	pointer to file structure
+ *
+ * @return	0: success
+ * @return	<0: error
+ *****************************************************************************/
+static int dev_cpu_map_open(struct inode *inode, struct file *fp)
+{
+	return dev_dbg_file_open(inode, fp);
+}
+
+/*****************************************************************************/
+/**
+ * dev_cpu_map_read() - static function that executes cpu map read
+ *
+ * @param[in]	fp:	pointer to file structure
+ * @param[out]	user_buffer: pointer to user buffer
+ * @param[in]	count: size of data to read
+ * @param[in/out]	ppos: pointer to offset read
+ *
+ * @return	>0: size read
+ * @return	<0: error
+ *****************************************************************************/
+static ssize_t dev_cpu_map_read(struct file *fp, char __user *user_buffer,
+		size_t count, loff_t *ppos)
+{
+	return dev_dbg_file_read(fp, user_buffer, count, ppos,
+			DBGFS_DEV_DBGF_CPU_MAP);
+}
 /*****************************************************************************/
 /**
  * dev_intr_cntx_open() -static function to open interrupt context debug file
@@ -843,6 +968,12 @@ static int create_dev_dbg_files(struct xlnx_dma_dev *xdev,
 			fops->read = dev_reg_info_read;
 			fops->release = dev_dbg_file_release;
 			break;
+		case DBGFS_DEV_DBGF_CPU_MAP:
+			snprintf(dbgf[i].name, 64, "%s", "qdma_cpu_map");
+			fops->open = dev_cpu_map_open;
+			fops->read = dev_cpu_map_read;
+			fops->release = dev_dbg_file_release;
+			break;
 		}
 	}
 
@@ -25,11 +25,12 @@
 #include "qdma_context.h"
 #include "qdma_descq.h"
 #include "qdma_regs.h"
+#include "qdma_st_c2h.h"
 #include <linux/uaccess.h>
 
 #ifdef DEBUGFS
 #define DEBUGFS_QUEUE_DESC_SZ	(100)
-#define DEBUGFS_QUEUE_INFO_SZ	(256)
+#define DEBUGFS_QUEUE_INFO_SZ	(512)
 #define DEBUGFS_QUEUE_CTXT_SZ	(24 * 1024)
 
 #define DEBUGFS_CTXT_ELEM(reg, pos, size)   \
@@ -546,6 +547,9 @@ static int qdbg_info_read(unsigned long dev_hndl, unsigned long id, char **data,
 	}
 
 	len = qdma_descq_dump_state(descq, buf + len, buflen - len);
+	if (descq->conf.st && (descq->conf.q_type == Q_C2H) &&
+			(descq->q_state == Q_STATE_ONLINE))
+		len += qdma_descq_dump_flq(descq, buf + len, buflen - len);
 
 	*data = buf;
 	*data_len = buflen;
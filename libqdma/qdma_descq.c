@@ -116,17 +116,30 @@ void qdma_update_request(void *q_hndl, struct qdma_request *req,
 	struct qdma_descq *descq = (struct qdma_descq *)q_hndl;
 	struct qdma_sgt_req_cb *cb = qdma_req_cb_get(req);
 
-	cb->desc_nr += num_desc;
 	cb->offset += data_cnt;
 	cb->sg_offset = sg_offset;
 	cb->sg = sg;
-	if (cb->offset >= req->count) {
-		qdma_work_queue_del(descq, cb);
-		list_add_tail(&cb->list, &descq->pend_list);
+	if (cb->offset < req->count)
+		return;
+
+	qdma_work_queue_pop(descq);
+	if (unlikely(!num_desc)) {
+		/* nothing of it is left on the descriptor ring */
+		lock_descq_cmpl(descq);
+		qdma_sgt_req_done(descq, cb, 0);
+		unlock_descq_cmpl(descq);
+		return;
 	}
+
+	/* hand the request over to the completion side, it is completed once
+	 * cidx moves past its last descriptor. hw can only report that after
+	 * the doorbell, which orders this store.
+	 */
+	WRITE_ONCE(descq->req_ring[ring_idx_decr(descq->pidx, 1,
+						 descq->conf.rngsz)], req);
 }
 
-static int descq_mm_n_h2c_cmpl_status(struct qdma_descq *descq);
+static int descq_mm_n_h2c_cmpl_reap(struct qdma_descq *descq);
 
 static int descq_poll_mm_n_h2c_cmpl_status(struct qdma_descq *descq)
 {
@@ -134,9 +147,22 @@ static int descq_poll_mm_n_h2c_cmpl_status(struct qdma_descq *descq)
 
 	if ((drv_mode == POLL_MODE) || (drv_mode == AUTO_MODE)) {
 		descq->proc_req_running = 1;
-		return descq_mm_n_h2c_cmpl_status(descq);
-	} else
-		return 0;
+		return descq_mm_n_h2c_cmpl_reap(descq);
+	}
+
+	/* pick up what the interrupt path has completed so far */
+	descq_avail_update(descq);
+	return 0;
+}
+
+/* must be called before the doorbell, so that the completion side cannot
+ * mark the pending list empty for descriptors it has not seen yet
+ */
+static inline void descq_pend_list_busy(struct qdma_descq *descq)
+{
+	lock_descq_cmpl(descq);
+	descq->pend_list_empty = 0;
+	unlock_descq_cmpl(descq);
 }
 
 static inline unsigned int incr_pidx(unsigned int pidx, unsigned int incr_val,
@@ -149,6 +175,26 @@ static inline unsigned int incr_pidx(unsigned int pidx, unsigned int incr_val,
 	return pidx;
 }
 
+static inline void descq_h2c_irq_timer_start(struct qdma_descq *descq)
+{
+	if (!hrtimer_is_queued(&descq->h2c_irq_timer))
+		hrtimer_start(&descq->h2c_irq_timer,
+			      ns_to_ktime(descq->h2c_irq_usecs * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+}
+
+/* arm the H2C interrupt once h2c_irq_frames descriptors are outstanding, the
+ * timer services the queue until then
+ */
+static inline void descq_h2c_irq_moder(struct qdma_descq *descq)
+{
+	unsigned int outstanding = descq->conf.rngsz - 1 - descq->avail;
+
+	descq->pidx_info.irq_en = (outstanding >= descq->h2c_irq_frames);
+	if (!descq->pidx_info.irq_en && outstanding)
+		descq_h2c_irq_timer_start(descq);
+}
+
 static inline int qdma_pidx_update(struct qdma_descq *descq,
 				unsigned char force)
 {
@@ -167,6 +213,8 @@ static inline int qdma_pidx_update(struct qdma_descq *descq,
 		goto exit_update;
 
 update:
+	if (descq->h2c_irq_frames)
+		descq_h2c_irq_moder(descq);
 	ret = queue_pidx_update(descq->xdev, descq->conf.qidx,
 			descq->conf.q_type, &descq->pidx_info);
 	if (ret < 0) {
@@ -184,6 +232,7 @@ exit_update:
 static ssize_t descq_mm_proc_request(struct qdma_descq *descq)
 {
 	int rv = 0;
+	struct qdma_request *req;
 	unsigned int desc_written = 0;
 	unsigned int rngsz = descq->conf.rngsz;
 	unsigned int pidx;
@@ -200,7 +249,7 @@ static ssize_t descq_mm_proc_request(struct qdma_descq *descq)
 	lock_descq(descq);
 	/* process completion of submitted requests */
 	if (descq->q_stop_wait) {
-		descq_mm_n_h2c_cmpl_status(descq);
+		descq_mm_n_h2c_cmpl_reap(descq);
 		unlock_descq(descq);
 		return 0;
 	}
@@ -219,10 +268,8 @@ static ssize_t descq_mm_proc_request(struct qdma_descq *descq)
 
 	descq_poll_mm_n_h2c_cmpl_status(descq);
 
-	while (!list_empty(&descq->work_list)) {
-		struct qdma_sgt_req_cb *cb = list_first_entry(&descq->work_list,
-						struct qdma_sgt_req_cb, list);
-		struct qdma_request *req = (struct qdma_request *)cb;
+	while ((req = qdma_work_queue_first_entry(descq))) {
+		struct qdma_sgt_req_cb *cb = qdma_req_cb_get(req);
 		struct qdma_sw_sg *sg = req->sgl;
 		unsigned int sg_offset = 0;
 		unsigned int sg_max = req->sgcnt;
@@ -362,10 +409,10 @@ static ssize_t descq_mm_proc_request(struct qdma_descq *descq)
 		desc_end->flag_len |= (1 << S_DESC_F_EOP);
 		/* set sop */
 		desc_start->flag_len |= (1 << S_DESC_F_SOP);
-		qdma_update_request(descq, req, desc_cnt, data_cnt, sg_offset,
-				    sg);
 		descq->pidx = pidx;
 		descq->avail -= desc_cnt;
+		qdma_update_request(descq, req, desc_cnt, data_cnt, sg_offset,
+				    sg);
 update_pidx:
 
 		desc_written += desc_cnt;
@@ -377,7 +424,7 @@ update_pidx:
 	}
 
 	if (desc_written) {
-		descq->pend_list_empty = 0;
+		descq_pend_list_busy(descq);
 		descq->pidx_info.pidx = descq->pidx;
 		rv = queue_pidx_update(descq->xdev, descq->conf.qidx,
 				descq->conf.q_type, &descq->pidx_info);
@@ -417,7 +464,7 @@ static ssize_t descq_proc_st_h2c_request_qep(struct qdma_descq *descq)
 
 	/* process completion of submitted requests */
 	if (unlikely(descq->q_stop_wait)) {
-		descq_mm_n_h2c_cmpl_status(descq);
+		descq_mm_n_h2c_cmpl_reap(descq);
 		unlock_descq(descq);
 		return 0;
 	}
@@ -428,8 +475,8 @@ static ssize_t descq_proc_st_h2c_request_qep(struct qdma_descq *descq)
 	}
 
 setup_desc:
-	while (qdma_work_queue_len(descq) && descq->avail) {
-		req = qdma_work_queue_first_entry(descq);
+	descq_avail_update(descq);
+	while (descq->avail && (req = qdma_work_queue_first_entry(descq))) {
 		desc_cnt = descq->conf.fp_bypass_desc_fill(descq,
 			QDMA_Q_MODE_ST, QDMA_Q_DIR_H2C, req);
 
@@ -456,6 +503,7 @@ setup_desc:
 
 	descq->desc_pend += desc_written;
 	descq->pidx_info.pidx = descq->pidx;
+	descq_pend_list_busy(descq);
 
 	ret = qdma_pidx_update(descq, 0);
 	if (unlikely(ret < 0)) {
@@ -465,7 +513,8 @@ setup_desc:
 		return -EINVAL;
 	}
 
-	if (descq->work_req_pend && (desc_written >= descq->conf.pidx_acc)) {
+	if (qdma_work_queue_len(descq) &&
+	    (desc_written >= descq->conf.pidx_acc)) {
 		desc_written = 0;
 		goto setup_desc;
 	}
@@ -479,6 +528,7 @@ setup_desc:
 static ssize_t descq_proc_st_h2c_request(struct qdma_descq *descq)
 {
 	int ret = 0;
+	struct qdma_request *req;
 	struct qdma_h2c_desc *desc;
 	u8 *tx_time_pkt_offset = NULL;
 	unsigned int rngsz = descq->conf.rngsz;
@@ -492,7 +542,7 @@ static ssize_t descq_proc_st_h2c_request(struct qdma_descq *descq)
 	lock_descq(descq);
 	/* process completion of submitted requests */
 	if (descq->q_stop_wait) {
-		descq_mm_n_h2c_cmpl_status(descq);
+		descq_mm_n_h2c_cmpl_reap(descq);
 		unlock_descq(descq);
 		return 0;
 	}
@@ -512,10 +562,8 @@ static ssize_t descq_proc_st_h2c_request(struct qdma_descq *descq)
 
 	pidx = descq->pidx;
 	desc = (struct qdma_h2c_desc *)descq->desc + pidx;
-	while (!list_empty(&descq->work_list)) {
-		struct qdma_sgt_req_cb *cb = list_first_entry(&descq->work_list,
-						struct qdma_sgt_req_cb, list);
-		struct qdma_request *req = (struct qdma_request *)cb;
+	while ((req = qdma_work_queue_first_entry(descq))) {
+		struct qdma_sgt_req_cb *cb = qdma_req_cb_get(req);
 		struct qdma_sw_sg *sg = req->sgl;
 		unsigned int sg_offset = 0;
 		unsigned int sg_max = req->sgcnt;
@@ -633,10 +681,10 @@ static ssize_t descq_proc_st_h2c_request(struct qdma_descq *descq)
 			sg = NULL;
 			sg_offset = 0;
 		}
-		qdma_update_request(descq, req, desc_cnt, data_cnt, sg_offset,
-				    sg);
 		descq->pidx = pidx;
 		descq->avail -= desc_cnt;
+		qdma_update_request(descq, req, desc_cnt, data_cnt, sg_offset,
+				    sg);
 update_pidx:
 		if (!desc_cnt)
 			break;
@@ -649,7 +697,7 @@ update_pidx:
 	}
 
 	if (desc_written) {
-		descq->pend_list_empty = 0;
+		descq_pend_list_busy(descq);
 		descq->pidx_info.pidx = descq->pidx;
 		if (descq->conf.ping_pong_en) {
 			if (tx_time_pkt_offset != NULL) {
@@ -663,7 +711,8 @@ update_pidx:
 				pr_err("Err: Tx Time Offset is NULL\n");
 		}
 
-
+		if (descq->h2c_irq_frames)
+			descq_h2c_irq_moder(descq);
 		ret = queue_pidx_update(descq->xdev, descq->conf.qidx,
 				descq->conf.q_type, &descq->pidx_info);
 		if (ret < 0) {
@@ -753,33 +802,30 @@ static void desc_alloc_irq(struct qdma_descq *descq)
 	 * on PF0, vector#0 is dedicated for Error interrupts and
 	 * vector #1 is dedicated for User interrupts
 	 * For all other PFs, vector#0 is dedicated for User interrupts
+	 * In indirect interrupt mode every data vector has its own
+	 * aggregation ring, the queues are spread over them the same way
 	 */
 
 	idx = xdev->dvec_start_idx;
-	if (xdev->conf.qdma_drv_mode == DIRECT_INTR_MODE) {
-		for (i = xdev->dvec_start_idx; i < xdev->conf.data_msix_qvec_max; i++) {
-			struct intr_info_t *intr_info_list =
-					&xdev->dev_intr_info_list[i];
-
-			spin_lock_irqsave(&intr_info_list->vec_q_list,
-					flags);
-			if (!intr_info_list->intr_list_cnt) {
-				spin_unlock_irqrestore(
-						&intr_info_list->vec_q_list,
-						flags);
-				idx = i;
-				break;
-			}
-			if (min < 0)
-				min = intr_info_list->intr_list_cnt;
-			if (intr_info_list->intr_list_cnt < min) {
-				min = intr_info_list->intr_list_cnt;
-				idx = i;
-			}
+	for (i = xdev->dvec_start_idx; i < xdev->conf.data_msix_qvec_max; i++) {
+		struct intr_info_t *intr_info_list =
+				&xdev->dev_intr_info_list[i];
 
+		spin_lock_irqsave(&intr_info_list->vec_q_list, flags);
+		if (!intr_info_list->intr_list_cnt) {
 			spin_unlock_irqrestore(&intr_info_list->vec_q_list,
-					flags);
+					       flags);
+			idx = i;
+			break;
 		}
+		if (min < 0)
+			min = intr_info_list->intr_list_cnt;
+		if (intr_info_list->intr_list_cnt < min) {
+			min = intr_info_list->intr_list_cnt;
+			idx = i;
+		}
+
+		spin_unlock_irqrestore(&intr_info_list->vec_q_list, flags);
 	}
 	descq->intr_id = idx;
 	pr_debug("descq->intr_id = %d allocated to qidx = %d\n",
@@ -787,18 +833,18 @@ static void desc_alloc_irq(struct qdma_descq *descq)
 }
 
 /*
- * writeback handling
+ * writeback handling, called with the descq cmpl_lock held. Returns the
+ * number of descriptors completed, the caller re-arms the interrupt.
  */
 static int descq_mm_n_h2c_cmpl_status(struct qdma_descq *descq)
 {
-	int rv = 0;
 	unsigned int cidx, cidx_hw;
-	unsigned int cr;
+	unsigned int done;
 
 	pr_debug("descq 0x%p, %s, pidx %u, cidx %u.\n",
-		descq, descq->conf.name, descq->pidx, descq->cidx);
+		descq, descq->conf.name, READ_ONCE(descq->pidx), descq->cidx);
 
-	if (descq->pidx == descq->cidx) { /* queue empty? */
+	if (READ_ONCE(descq->pidx) == descq->cidx) { /* queue empty? */
 		pr_debug("descq %s empty, return.\n", descq->conf.name);
 		return 0;
 	}
@@ -813,61 +859,92 @@ static int descq_mm_n_h2c_cmpl_status(struct qdma_descq *descq)
 	dma_rmb();
 #endif
 
-	if (cidx_hw == cidx) /* no new writeback? */
+	if (cidx_hw == cidx) { /* no new writeback? */
+		/* keep servicing while the interrupt is not armed */
+		if (descq->h2c_irq_frames &&
+		    !READ_ONCE(descq->pidx_info.irq_en))
+			descq_h2c_irq_timer_start(descq);
 		return 0;
+	}
 
-	/* completion credits */
-	cr = (cidx_hw < cidx) ? (descq->conf.rngsz - cidx) + cidx_hw :
-				cidx_hw - cidx;
+	done = ring_idx_delta(cidx_hw, cidx, descq->conf.rngsz);
 
-	pr_debug("%s descq %s, cidx 0x%x -> 0x%x, avail 0x%x + 0x%x.\n",
-			__func__, descq->conf.name, cidx,
-			cidx_hw, descq->avail, cr);
+	pr_debug("%s descq %s, cidx 0x%x -> 0x%x, done 0x%x.\n",
+			__func__, descq->conf.name, cidx, cidx_hw, done);
 
-	descq->cidx = cidx_hw;
-	descq->avail += cr;
-	descq->credit += cr;
+	incr_cmpl_desc_cnt(descq, done);
 
-	incr_cmpl_desc_cnt(descq, cr);
+	/* completes the requests whose last descriptor is done, before the
+	 * producer can reuse their slots
+	 */
+	for (; cidx != cidx_hw; cidx = ring_idx_incr(cidx, 1,
+						      descq->conf.rngsz)) {
+		struct qdma_request *req = descq->req_ring[cidx];
 
-	/* completes requests */
-	pr_debug("%s %s, 0x%p, credit %u + %u.\n",
-			__func__, descq->conf.name, descq, cr, descq->credit);
+		if (!req)
+			continue;
 
-	cr = descq->credit;
+		pr_debug("%s, 0x%p, req 0x%p done at 0x%x.\n",
+			descq->conf.name, descq, req, cidx);
+		descq->req_ring[cidx] = NULL;
+		qdma_sgt_req_done(descq, qdma_req_cb_get(req), 0);
+	}
 
-	while (!list_empty(&descq->pend_list)) {
-		struct qdma_sgt_req_cb *cb = list_first_entry(&descq->pend_list,
-						struct qdma_sgt_req_cb, list);
+	/* the descriptors can be reused by the producer from here on */
+	smp_store_release(&descq->cidx, cidx_hw);
 
-		pr_debug("%s, 0x%p, cb 0x%p, desc_nr %u, credit %u.\n",
-			descq->conf.name, descq, cb, cb->desc_nr, cr);
+	descq->pend_list_empty = (READ_ONCE(descq->pidx) == cidx_hw);
+	if (descq->q_stop_wait && descq->pend_list_empty)
+		qdma_waitq_wakeup(&descq->pend_list_wq);
 
-		if (cr >= cb->desc_nr) {
-			pr_debug("%s, cb 0x%p done, credit %u > %u.\n",
-				descq->conf.name, cb, cr, cb->desc_nr);
-			cr -= cb->desc_nr;
-			qdma_sgt_req_done(descq, cb, 0);
-		} else {
-			pr_debug("%s, cb 0x%p not done, credit %u < %u.\n",
-				descq->conf.name, cb, cr, cb->desc_nr);
-			cb->desc_nr -= cr;
-			cr = 0;
-		}
+	return done;
+}
 
-		if (!cr)
-			break;
-	}
+/* re-arm the interrupt with a pidx update, called with the descq lock held */
+static inline void descq_mm_n_h2c_irq_rearm(struct qdma_descq *descq)
+{
+	descq_avail_update(descq);
+	if (unlikely(qdma_pidx_update(descq, 1) < 0))
+		pr_err("%s: Failed to update pidx\n", descq->conf.name);
+}
 
-	descq->credit = cr;
-	pr_debug("%s, 0x%p, credit %u.\n",
-		descq->conf.name, descq, descq->credit);
+/* completion processing from the producer, called with the descq lock held */
+static int descq_mm_n_h2c_cmpl_reap(struct qdma_descq *descq)
+{
+	int done;
 
-	rv = qdma_pidx_update(descq, 1);
-	if (unlikely(rv < 0))
-		pr_err("%s: Failed to update pidx\n", descq->conf.name);
+	lock_descq_cmpl(descq);
+	done = descq_mm_n_h2c_cmpl_status(descq);
+	unlock_descq_cmpl(descq);
 
-	return 0;
+	if (done)
+		descq_mm_n_h2c_irq_rearm(descq);
+	else
+		descq_avail_update(descq);
+
+	return done;
+}
+
+/* completion processing from the interrupt/poll context, only the interrupt
+ * re-arm has to be serialised against the producer
+ */
+static int descq_mm_n_h2c_cmpl_service(struct qdma_descq *descq)
+{
+	int done;
+
+	lock_descq_cmpl(descq);
+	done = descq_mm_n_h2c_cmpl_status(descq);
+	unlock_descq_cmpl(descq);
+
+	if (!done)
+		return 0;
+
+	lock_descq(descq);
+	if (descq->q_state == Q_STATE_ONLINE)
+		descq_mm_n_h2c_irq_rearm(descq);
+	unlock_descq(descq);
+
+	return done;
 }
 
 /* ************** public function definitions ******************************* */
@@ -880,13 +957,14 @@ void qdma_descq_init(struct qdma_descq *descq, struct xlnx_dma_dev *xdev,
 	memset(descq, 0, sizeof(struct qdma_descq));
 
 	spin_lock_init(&descq->lock);
-	spin_lock_init(&descq->work_list_lock);
-	INIT_LIST_HEAD(&descq->work_list);
+	spin_lock_init(&descq->cmpl_lock);
 	INIT_LIST_HEAD(&descq->pend_list);
 	qdma_waitq_init(&descq->pend_list_wq);
-	INIT_LIST_HEAD(&descq->intr_list);
 	INIT_LIST_HEAD(&descq->legacy_intr_q_list);
 	INIT_WORK(&descq->work, intr_work);
+	INIT_WORK(&descq->flq_refill_work, descq_flq_refill_work);
+	hrtimer_init(&descq->h2c_irq_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	descq->h2c_irq_timer.function = intr_h2c_timer;
 	descq->xdev = xdev;
 	descq->channel = 0;
 	descq->qidx_hw = qdev->qbase + idx_hw;
@@ -909,8 +987,8 @@ int qdma_q_desc_get(void *q_hndl, const unsigned int desc_cnt,
 	 * giving writeback and sometimes its corresponding interrupt. For this
 	 * reason a polling logic is introduced as below
 	 **/
-	if (descq->avail < desc_cnt)
-		descq_mm_n_h2c_cmpl_status(descq);
+	if (descq_avail_update(descq) < desc_cnt)
+		descq_mm_n_h2c_cmpl_reap(descq);
 
 	if (unlikely(descq->avail < desc_cnt)) {
 		pr_err("No entries available to read");
@@ -970,6 +1048,44 @@ int qdma_q_init_pointers(void *q_hndl)
 }
 
 int qdma_queue_update_pointers(unsigned long dev_hndl, unsigned long qhndl)
+{
+	return qdma_queue_update_pointers_irq(dev_hndl, qhndl, true);
+}
+
+int descq_c2h_update_pointers(struct qdma_descq *descq, bool irq_arm)
+{
+	uint8_t irq_en;
+	int ret;
+
+	/** keep the completion interrupt masked while the
+	 *  caller still owns the queue (e.g. busy polling)
+	 */
+	irq_en = descq->cmpt_cidx_info.irq_en;
+	if (!irq_arm)
+		descq->cmpt_cidx_info.irq_en = 0;
+	ret = queue_cmpt_cidx_update(descq->xdev, descq->conf.qidx,
+				     &descq->cmpt_cidx_info);
+	descq->cmpt_cidx_info.irq_en = irq_en;
+	if (ret < 0) {
+		pr_err("%s: Failed to update cmpt cidx\n", descq->conf.name);
+		return -EBUSY;
+	}
+	ret = queue_pidx_update(descq->xdev, descq->conf.qidx,
+				descq->conf.q_type, &descq->pidx_info);
+	if (ret < 0) {
+		pr_err("%s: Failed to update pidx\n", descq->conf.name);
+		return -EBUSY;
+	}
+	/*
+	 * Memory barrier in update pointers
+	 */
+	wmb();
+
+	return 0;
+}
+
+int qdma_queue_update_pointers_irq(unsigned long dev_hndl,
+				   unsigned long qhndl, bool irq_arm)
 {
 	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
 	struct qdma_descq *descq = qdma_device_get_descq_by_id(xdev, qhndl,
@@ -984,43 +1100,19 @@ int qdma_queue_update_pointers(unsigned long dev_hndl, unsigned long qhndl)
 	if (descq->conf.st && (descq->conf.q_type == Q_C2H)) {
 		lock_descq(descq);
 		if (descq->q_state == Q_STATE_ONLINE) {
-			ret = queue_cmpt_cidx_update(descq->xdev,
-					descq->conf.qidx,
-					&descq->cmpt_cidx_info);
-			if (ret < 0) {
-				pr_err("%s: Failed to update cmpt cidx\n",
-						descq->conf.name);
-
-				ret = -EBUSY;
-				goto func_exit;
-			}
-			ret = queue_pidx_update(descq->xdev,
-					descq->conf.qidx,
-					descq->conf.q_type,
-					&descq->pidx_info);
-			if (ret < 0) {
-				pr_err("%s: Failed to update pidx\n",
-						descq->conf.name);
-				ret = -EBUSY;
-				goto func_exit;
-			}
-			/*
-			 * Memory barrier in update pointers
-			 */
-			wmb();
+			ret = descq_c2h_update_pointers(descq, irq_arm);
 		} else {
 			pr_debug("Pointer update for offline queue for %s",
 					descq->conf.name);
 			ret =  -ENODEV;
 		}
+		unlock_descq(descq);
 	} else {
 		pr_err("Pointer update for invalid queue for %s",
 					descq->conf.name);
 		ret =  -EINVAL;
 	}
 
-func_exit:
-	unlock_descq(descq);
 	return ret;
 
 }
@@ -1090,7 +1182,24 @@ int qdma_descq_alloc_resource(struct qdma_descq *descq)
 					__func__);
 			goto err_out;
 		}
-	} else if (is_ul_ext) {
+	} else if (descq->conf.q_type != Q_CMPT) {
+		/* H2C and MM request rings */
+		unsigned int work_sz = get_next_powof2(descq->conf.rngsz);
+
+		descq->work_ring = kcalloc(work_sz,
+					   sizeof(struct qdma_request *),
+					   GFP_KERNEL);
+		descq->req_ring = kcalloc(descq->conf.rngsz,
+					  sizeof(struct qdma_request *),
+					  GFP_KERNEL);
+		if (!descq->work_ring || !descq->req_ring) {
+			pr_err("request ring allocation failed.OOM");
+			goto err_out;
+		}
+		descq->work_ring_mask = work_sz - 1;
+	}
+
+	if (is_ul_ext && !(descq->conf.st && (descq->conf.q_type == Q_C2H))) {
 		int i;
 		unsigned int desc_sz = get_desc_size(descq);
 
@@ -1178,8 +1287,14 @@ void qdma_descq_free_resource(struct qdma_descq *descq)
 		if (descq->conf.st && (descq->conf.q_type == Q_C2H)) {
 			descq_flq_free_resource(descq);
 			descq_flq_free_page_resource(descq);
-		} else
+		} else {
 			kfree(descq->desc_list);
+			descq->desc_list = NULL;
+			kfree(descq->work_ring);
+			descq->work_ring = NULL;
+			kfree(descq->req_ring);
+			descq->req_ring = NULL;
+		}
 
 		desc_ring_free(descq->xdev, descq->conf.rngsz, desc_sz, cs_sz,
 				descq->desc, descq->desc_bus);
@@ -1307,6 +1422,8 @@ int qdma_descq_config_complete(struct qdma_descq *descq)
 		descq->pidx_info.irq_en = 0;
 	else
 		descq->pidx_info.irq_en = descq->conf.irq_en;
+	descq->h2c_irq_frames = 0;
+	descq->h2c_irq_usecs = 0;
 
 	/* we can never use the full ring because then cidx would equal pidx
 	 * and thus the ring would be interpreted as empty. Thus max number of
@@ -1318,9 +1435,8 @@ int qdma_descq_config_complete(struct qdma_descq *descq)
 	descq->pidx = 0;
 	descq->cidx = 0;
 	descq->cidx_cmpt = 0;
-	descq->pidx_cmpt = 0;
-	descq->credit = 0;
-	descq->work_req_pend = 0;
+	descq->work_head = 0;
+	descq->work_tail = 0;
 
 	/* ST C2H only */
 	if ((qconf->st && (qconf->q_type == Q_C2H)) ||
@@ -1444,14 +1560,10 @@ int qdma_descq_service_cmpl_update(struct qdma_descq *descq, int budget,
 			unlock_descq(descq);
 		}
 	} else {
-		lock_descq(descq);
-		descq_mm_n_h2c_cmpl_status(descq);
-		if (qdma_work_queue_len(descq) || descq->desc_pend) {
-			unlock_descq(descq);
+		descq_mm_n_h2c_cmpl_service(descq);
+		/* lockless hint, the request processing rechecks */
+		if (qdma_work_queue_len(descq) || READ_ONCE(descq->desc_pend))
 			rv = qdma_descq_proc_sgt_request(descq);
-			return rv;
-		}
-		unlock_descq(descq);
 	}
 
 	return rv;
@@ -1473,18 +1585,24 @@ ssize_t qdma_descq_proc_sgt_request(struct qdma_descq *descq)
 
 void incr_cmpl_desc_cnt(struct qdma_descq *descq, unsigned int cnt)
 {
-	descq->total_cmpl_descs += cnt;
+	/** each count sits with the completion side of its queue type, see
+	 *  struct qdma_descq
+	 */
 	switch ((descq->conf.st << 1) | descq->conf.q_type) {
 	case 0:
+		descq->total_cmpl_descs += cnt;
 		descq->xdev->total_mm_h2c_pkts += cnt;
 		break;
 	case 1:
+		descq->total_cmpl_descs += cnt;
 		descq->xdev->total_mm_c2h_pkts += cnt;
 		break;
 	case 2:
+		descq->total_cmpl_descs += cnt;
 		descq->xdev->total_st_h2c_pkts += cnt;
 		break;
 	case 3:
+		descq->c2h_cmpl_descs += cnt;
 		descq->xdev->total_st_c2h_pkts += cnt;
 		break;
 	default:
@@ -1501,7 +1619,9 @@ void qdma_sgt_req_done(struct qdma_descq *descq, struct qdma_sgt_req_cb *cb,
 		pr_err("req 0x%p, cb 0x%p, fp_done 0x%p done, err %d.\n",
 			req, cb, req->fp_done, error);
 
-	list_del(&cb->list);
+	/* H2C and MM requests are already off the request ring */
+	if (descq->conf.st && (descq->conf.q_type == Q_C2H))
+		list_del(&cb->list);
 	if (cb->unmap_needed) {
 		sgl_unmap(descq->xdev->conf.pdev, req->sgl, req->sgcnt,
 			(descq->conf.q_type == Q_C2H) ?
@@ -1526,12 +1646,12 @@ void qdma_sgt_req_done(struct qdma_descq *descq, struct qdma_sgt_req_cb *cb,
 		qdma_waitq_wakeup(&cb->wq);
 	}
 
+	/* H2C and MM: descq_mm_n_h2c_cmpl_status() tracks the ring instead */
+	if (!descq->conf.st || (descq->conf.q_type != Q_C2H))
+		return;
+
 	if (!descq->conf.fp_descq_c2h_packet) {
-		if (descq->conf.st && (descq->conf.q_type == Q_C2H))
-			descq->pend_list_empty = (descq->avail == 0);
-		else
-			descq->pend_list_empty = (descq->avail ==
-					(descq->conf.rngsz - 1));
+		descq->pend_list_empty = (descq->avail == 0);
 
 		if (descq->q_stop_wait && descq->pend_list_empty)
 			qdma_waitq_wakeup(&descq->pend_list_wq);
@@ -1539,6 +1659,33 @@ void qdma_sgt_req_done(struct qdma_descq *descq, struct qdma_sgt_req_cb *cb,
 		descq->pend_list_empty = 1;
 }
 
+void qdma_descq_cancel_request(struct qdma_descq *descq,
+				struct qdma_request *req)
+{
+	struct qdma_sgt_req_cb *cb = qdma_req_cb_get(req);
+	unsigned int i;
+
+	if (descq->conf.st && (descq->conf.q_type == Q_C2H)) {
+		list_del(&cb->list);
+		return;
+	}
+
+	/* the request is on one of the rings, clearing its slot is enough */
+	for (i = descq->work_head; i != descq->work_tail; i++) {
+		if (descq->work_ring[i & descq->work_ring_mask] == req) {
+			descq->work_ring[i & descq->work_ring_mask] = NULL;
+			return;
+		}
+	}
+
+	for (i = 0; i < descq->conf.rngsz; i++) {
+		if (descq->req_ring[i] == req) {
+			descq->req_ring[i] = NULL;
+			return;
+		}
+	}
+}
+
 int qdma_descq_dump_desc(struct qdma_descq *descq, int start,
 			int end, char *buf, int buflen)
 {
@@ -1723,6 +1870,10 @@ int qdma_descq_dump(struct qdma_descq *descq, char *buf, int buflen, int detail)
 			descq->conf.rngsz_cmpt);
 		if (cur >= end)
 			goto handle_truncation;
+
+		cur += qdma_descq_dump_flq(descq, cur, end - cur);
+		if (cur >= end)
+			goto handle_truncation;
 	}
 
 	if (!detail)
@@ -1798,7 +1949,10 @@ int qdma_queue_avail_desc(unsigned long dev_hndl, unsigned long id)
 	}
 
 	lock_descq(descq);
-	avail = descq->avail;
+	if (descq->conf.st && (descq->conf.q_type == Q_C2H))
+		avail = descq->avail;
+	else
+		avail = descq_avail_update(descq);
 	unlock_descq(descq);
 
 	return avail;
@@ -1836,46 +1990,26 @@ int qdma_queue_set_err_induction(unsigned long dev_hndl, unsigned long id,
 }
 #endif
 
-int qdma_queue_packet_write(unsigned long dev_hndl, unsigned long id,
-				struct qdma_request *req)
+int qdma_queue_packet_write_fp(struct qdma_descq *descq,
+			       struct qdma_request *req)
 {
-	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
-	struct qdma_descq *descq;
 	struct qdma_sgt_req_cb *cb;
 	int rv;
 
-	/** make sure that the dev_hndl passed is Valid */
-	if (unlikely(!xdev)) {
-		pr_err("dev_hndl is NULL");
-		return -EINVAL;
-	}
-
-	if (unlikely(xdev_check_hndl(__func__,
-				xdev->conf.pdev, dev_hndl) < 0)) {
-		pr_err("Invalid dev_hndl passed");
+	if (unlikely(descq_fp_check(descq) < 0))
 		return -EINVAL;
-	}
-
-	if (unlikely(!req)) {
-		pr_err("req is NULL");
-		return -EINVAL;
-	}
-
-	cb = qdma_req_cb_get(req);
-
-	descq = qdma_device_get_descq_by_id(xdev, id, NULL, 0, 0);
-	if (unlikely(!descq)) {
-		pr_err("Invalid qid: %ld", id);
+#ifdef DEBUG
+	if (unlikely(!req))
 		return -EINVAL;
-	}
 
 	if (unlikely(!descq->conf.st || (descq->conf.q_type == Q_C2H))) {
 		pr_err("%s: st %d, type %d.\n",
 			descq->conf.name, descq->conf.st, descq->conf.q_type);
 		return -EINVAL;
 	}
+#endif
 
-	qdma_work_queue_add(descq, cb);
+	cb = qdma_req_cb_get(req);
 
 	if (!req->dma_mapped) {
 		rv = sgl_map(descq->xdev->conf.pdev, req->sgl, req->sgcnt,
@@ -1888,17 +2022,20 @@ int qdma_queue_packet_write(unsigned long dev_hndl, unsigned long id,
 		cb->unmap_needed = 1;
 	}
 
-	if (!req->check_qstate_disabled) {
-		lock_descq(descq);
-		if (descq->q_state != Q_STATE_ONLINE) {
-			unlock_descq(descq);
-			pr_err("%s descq %s NOT online.\n",
-				descq->xdev->conf.name, descq->conf.name);
-			rv = -EINVAL;
-			goto unmap_sgl;
-		}
+	/* the work list belongs to the producer side */
+	lock_descq(descq);
+	if (!req->check_qstate_disabled &&
+	    descq->q_state != Q_STATE_ONLINE) {
 		unlock_descq(descq);
+		pr_err("%s descq %s NOT online.\n",
+			descq->xdev->conf.name, descq->conf.name);
+		rv = -EINVAL;
+		goto unmap_sgl;
 	}
+	rv = qdma_work_queue_add(descq, cb);
+	unlock_descq(descq);
+	if (unlikely(rv < 0))
+		goto unmap_sgl;
 
 	qdma_descq_proc_sgt_request(descq);
 
@@ -1915,6 +2052,59 @@ unmap_sgl:
 	return rv;
 }
 
+int qdma_queue_write_room_fp(struct qdma_descq *descq)
+{
+	unsigned int head, len;
+
+	if (unlikely(descq_fp_check(descq) < 0))
+		return -EINVAL;
+
+	/* head first: a tail read later can only overestimate the length */
+	head = READ_ONCE(descq->work_head);
+	len = READ_ONCE(descq->work_tail) - head;
+
+	return len > descq->work_ring_mask ? 0 :
+		descq->work_ring_mask + 1 - len;
+}
+
+int qdma_queue_packet_write(unsigned long dev_hndl, unsigned long id,
+				struct qdma_request *req)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_descq *descq;
+
+	/** make sure that the dev_hndl passed is Valid */
+	if (unlikely(!xdev)) {
+		pr_err("dev_hndl is NULL");
+		return -EINVAL;
+	}
+
+	if (unlikely(xdev_check_hndl(__func__,
+				xdev->conf.pdev, dev_hndl) < 0)) {
+		pr_err("Invalid dev_hndl passed");
+		return -EINVAL;
+	}
+
+	if (unlikely(!req)) {
+		pr_err("req is NULL");
+		return -EINVAL;
+	}
+
+	descq = qdma_device_get_descq_by_id(xdev, id, NULL, 0, 0);
+	if (unlikely(!descq)) {
+		pr_err("Invalid qid: %ld", id);
+		return -EINVAL;
+	}
+
+	if (unlikely(!descq->conf.st || (descq->conf.q_type == Q_C2H))) {
+		pr_err("%s: st %d, type %d.\n",
+			descq->conf.name, descq->conf.st, descq->conf.q_type);
+		return -EINVAL;
+	}
+
+	return qdma_queue_packet_write_fp(descq, req);
+}
+
 int qdma_descq_get_cmpt_udd(unsigned long dev_hndl, unsigned long id,
 		char *buf, int buflen)
 {
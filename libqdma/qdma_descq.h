@@ -26,6 +26,9 @@
  */
 #include <linux/spinlock_types.h>
 #include <linux/types.h>
+#include <linux/hrtimer.h>
+#include <linux/cache.h>
+#include <asm/barrier.h>
 #include "qdma_compat.h"
 #include "libqdma_export.h"
 #include "qdma_regs.h"
@@ -49,125 +52,99 @@ struct q_state_name {
 
 extern struct q_state_name q_state_list[];
 
-#define QDMA_FLQ_SIZE 124
+#define QDMA_FLQ_SIZE 144
 
 /**
  * @struct - qdma_descq
  * @brief	qdma software descriptor book keeping fields
  */
 struct qdma_descq {
-	/** qdma queue configuration */
+	/** qdma queue configuration, its first cache line holds the fields
+	 *  read on every packet
+	 */
 	struct qdma_queue_conf conf;
-	/** lock to protect access to software descriptor */
-	spinlock_t lock;
+
+	/* read mostly: set up with the queue, read by both fast paths */
 	/** pointer to dma device */
-	struct xlnx_dma_dev *xdev;
-	/** number of channels */
-	u8 channel;
-	/** flag to indicate error on the Q, in halted state */
-	u8 err:1;
-	/** color bit for the queue */
-	u8 color:1;
-	/** cpu attached */
-	u8 cpu_assigned:1;
-	/** state of the proc req */
-	u8 proc_req_running;
-	/* rx_time in CPU timestamp of ping_pong pkt for
-	 * measuring H2C-C2H loopback latency
-	 */
-	u64 ping_pong_rx_time;
-	/* tx_time in CPU timestamp of ping_pong pkt for
-	 * measuring H2C-C2H loopback latency
+	struct xlnx_dma_dev *xdev ____cacheline_aligned_in_smp;
+	/** desctor to be processed*/
+	u8 *desc;
+	/** pointer to completion entry */
+	u8 *desc_cmpt;
+	/** descriptor writeback dma bus address*/
+	u8 *desc_cmpt_cmpl_status;
+	/** H2C and MM requests submitted to hw, indexed by the descriptor
+	 *  ring index of their last descriptor
 	 */
-	u64 ping_pong_tx_time;
+	struct qdma_request **req_ring;
+	/** @q_hndl: Q handle, a queue index below 3 * qmax */
+	unsigned int q_hndl;
 	/** Indicate q state */
 	enum q_state_t q_state;
-	/** hw qidx associated for this queue */
-	unsigned int qidx_hw;
-	/** cpu attached to intr_work */
-	unsigned int intr_work_cpu;
-	/** @q_hndl: Q handle */
-	unsigned long q_hndl;
-	/** queue handler */
-	struct work_struct work;
-	/** interrupt list */
-	struct list_head intr_list;
-	/** leagcy interrupt list */
-	struct list_head legacy_intr_q_list;
-	/** interrupt id associated for this queue */
-	int intr_id;
-	/** work  list for the queue */
-	struct list_head work_list;
-	/** current req count */
-	unsigned int work_req_pend;
-	/* lock to synchonize  work queue access*/
-	spinlock_t work_list_lock;
-	/** write back therad list */
-	struct qdma_kthread *cmplthp;
-	/** completion status thread list for the queue */
-	struct list_head cmplthp_list;
-	/** pending qork thread list */
-	struct list_head pend_list;
-	/** wait queue for pending list clear */
-	qdma_wait_queue pend_list_wq;
-	/** pending list empty count */
-	unsigned int pend_list_empty;
+	/** @h2c_irq_frames: outstanding descriptors arming the interrupt,
+	 *  0 arms it with every pidx update
+	 */
+	unsigned int h2c_irq_frames;
+	/** @h2c_irq_usecs: delay of h2c_irq_timer */
+	unsigned int h2c_irq_usecs;
+	/** work_ring size - 1, the size is a power of 2 */
+	unsigned int work_ring_mask;
 	/* flag to indicate wwaiting for transfers to complete before q stop*/
-	unsigned int q_stop_wait;
-	/** availed count */
+	u8 q_stop_wait;
+	/** cmpt entry length*/
+	unsigned char cmpt_entry_len;
+
+	/* producer side of H2C and MM queues, the completion side of ST C2H
+	 * queues; also serialises the queue state
+	 */
+	/** lock to protect the queue state and the producer side */
+	spinlock_t lock ____cacheline_aligned_in_smp;
+	/** availed count, H2C and MM queues derive it from cidx */
 	unsigned int avail;
-	/** current req count */
-	unsigned int pend_req_desc;
 	/** current producer index */
 	unsigned int pidx;
-	/** current consumer index */
+	/** pidx info to be written to PIDX regiser*/
+	struct qdma_q_pidx_reg_info pidx_info;
+	/** @desc_pend: pending desc to be updated processed by hw */
+	unsigned char desc_pend;
+	/** state of the proc req */
+	u8 proc_req_running;
+	/** flag to indicate error on the Q, in halted state */
+	u8 err:1;
+	/** color bit for the queue */
+	u8 color:1;
+	/** free running index of the next request to be processed */
+	unsigned int work_head;
+	/** H2C and MM requests not fully on the descriptor ring yet */
+	struct qdma_request **work_ring;
+	/** free running index of the next free work_ring entry */
+	unsigned int work_tail;
+	/** completion cidx */
+	unsigned int cidx_cmpt;
+	/** cmpt cidx info to be written to CMPT CIDX regiser*/
+	struct qdma_q_cmpt_cidx_reg_info cmpt_cidx_info;
+	/** descriptor writeback, data type depends on the cmpt_entry_len */
+	void *desc_cmpt_cur;
+	/** number of packets processed in an ST C2H q, total_cmpl_descs
+	 *  counts them for the other queues
+	 */
+	unsigned long long c2h_cmpl_descs;
+
+	/* consumer side, H2C and MM queues only, ST C2H keeps using lock */
+	/** lock to protect the completion processing */
+	spinlock_t cmpl_lock ____cacheline_aligned_in_smp;
+	/** current consumer index, published to the producer */
 	unsigned int cidx;
-	/** number of descrtors yet to be processed*/
-	unsigned int credit;
-	/** desctor to be processed*/
-	u8 *desc;
-	/** desctor dma address*/
-	dma_addr_t desc_bus;
+	/** pending list empty count */
+	unsigned int pend_list_empty;
 	/** desctor writeback*/
 	u8 *desc_cmpl_status;
+	/** number of packets processed in an H2C or MM q */
+	unsigned long long total_cmpl_descs;
 
-	/* ST C2H */
-	/** programming order of the data in ST c2h mode*/
-	unsigned char fl_pg_order;
-	/** cmpt entry length*/
-	unsigned char cmpt_entry_len;
-	/** 2 bits reserved*/
-	unsigned char rsvd[2];
+	/* ST C2H freelist, struct qdma_flq keeps its per packet fields first */
 	/** qdma free list q*/
-	unsigned char flq[QDMA_FLQ_SIZE];
-	/**total # of udd outstanding */
-	unsigned int udd_cnt;
-	/** packet count/number of packets to be processed*/
-	unsigned int pkt_cnt;
-	/** packet data length */
-	unsigned int pkt_dlen;
-	/** pidx of the completion entry */
-	unsigned int pidx_cmpt;
-	/** completion cidx */
-	unsigned int cidx_cmpt;
-	/** number of packets processed in q */
-	unsigned long long total_cmpl_descs;
-	/** descriptor writeback, data type depends on the cmpt_entry_len */
-	void *desc_cmpt_cur;
-	/* descriptor list to be provided for ul extenstion call */
-	struct qdma_q_desc_list *desc_list;
-	/** pointer to completion entry */
-	u8 *desc_cmpt;
-	/** descriptor dma bus address*/
-	dma_addr_t desc_cmpt_bus;
-	/** descriptor writeback dma bus address*/
-	u8 *desc_cmpt_cmpl_status;
-	/** @desc_pend: pending desc to be updated processed by hw */
-	unsigned char desc_pend;
-	/** pidx info to be written to PIDX regiser*/
-	struct qdma_q_pidx_reg_info pidx_info;
-	/** cmpt cidx info to be written to CMPT CIDX regiser*/
-	struct qdma_q_cmpt_cidx_reg_info cmpt_cidx_info;
+	unsigned char flq[QDMA_FLQ_SIZE] ____cacheline_aligned_in_smp;
 	/** @c2h_pend_pkt_moving_avg: average rate of packets received */
 	unsigned int c2h_pend_pkt_moving_avg;
 	/** @c2h_pend_pkt_avg_thr_hi: higher average threshold */
@@ -178,6 +155,58 @@ struct qdma_descq {
 	unsigned char sorted_c2h_cntr_idx;
 	/** @c2h_cntr_monitor_cnt: c2h counter stagnant monitor count */
 	unsigned char c2h_cntr_monitor_cnt;
+
+	/* cold: setup, teardown, slow paths and debug */
+	/** ST C2H read requests waiting for data */
+	struct list_head pend_list;
+	/** wait queue for pending list clear */
+	qdma_wait_queue pend_list_wq;
+	/** desctor dma address*/
+	dma_addr_t desc_bus;
+	/** descriptor dma bus address*/
+	dma_addr_t desc_cmpt_bus;
+	/* descriptor list to be provided for ul extenstion call */
+	struct qdma_q_desc_list *desc_list;
+	/** hw qidx associated for this queue */
+	unsigned int qidx_hw;
+	/** number of channels */
+	u8 channel;
+	/** cpu attached */
+	u8 cpu_assigned;
+	/** references on the global csr slots of conf are held */
+	u8 csr_slots_held;
+	/** cpu attached to intr_work */
+	unsigned int intr_work_cpu;
+	/** interrupt id associated for this queue */
+	int intr_id;
+	/** queue handler */
+	struct work_struct work;
+	/** time work was queued, in ns */
+	u64 work_qtime;
+	/** freelist refill in process context */
+	struct work_struct flq_refill_work;
+	/** time flq_refill_work was queued, in ns */
+	u64 flq_refill_qtime;
+	/** leagcy interrupt list */
+	struct list_head legacy_intr_q_list;
+	/** rcu state when the queue left the queue table of its vector */
+	unsigned long intr_tbl_gp;
+	/** write back therad list */
+	struct qdma_kthread *cmplthp;
+	/** completion status thread list for the queue */
+	struct list_head cmplthp_list;
+	/** @h2c_irq_timer: services the queue while the interrupt is not
+	 *  armed
+	 */
+	struct hrtimer h2c_irq_timer;
+	/* rx_time in CPU timestamp of ping_pong pkt for
+	 * measuring H2C-C2H loopback latency
+	 */
+	u64 ping_pong_rx_time;
+	/* tx_time in CPU timestamp of ping_pong pkt for
+	 * measuring H2C-C2H loopback latency
+	 */
+	u64 ping_pong_tx_time;
 #ifdef ERR_DEBUG
 	/** flag to indicate error inducing */
 	u64 induce_err;
@@ -204,11 +233,52 @@ struct qdma_descq {
 		pr_debug("unlock descq %s ...\n", (descq)->conf.name); \
 		spin_unlock_bh(&(descq)->lock); \
 	} while (0)
+
+#define lock_descq_cmpl(descq)	\
+	do { \
+		pr_debug("locking descq %s cmpl ...\n", (descq)->conf.name); \
+		spin_lock_bh(&(descq)->cmpl_lock); \
+	} while (0)
+
+#define unlock_descq_cmpl(descq) \
+	do { \
+		pr_debug("unlock descq %s cmpl ...\n", (descq)->conf.name); \
+		spin_unlock_bh(&(descq)->cmpl_lock); \
+	} while (0)
 #else
 /** macro to lock descq */
 #define lock_descq(descq)	spin_lock_bh(&(descq)->lock)
 /** macro to un lock descq */
 #define unlock_descq(descq)	spin_unlock_bh(&(descq)->lock)
+/** macro to lock the completion side of a descq, nests inside lock_descq */
+#define lock_descq_cmpl(descq)	spin_lock_bh(&(descq)->cmpl_lock)
+/** macro to un lock the completion side of a descq */
+#define unlock_descq_cmpl(descq)	spin_unlock_bh(&(descq)->cmpl_lock)
+#endif
+
+/** macros to serialise the queue state transitions against both sides */
+#define lock_descq_all(descq) \
+	do { \
+		lock_descq(descq); \
+		lock_descq_cmpl(descq); \
+	} while (0)
+
+#define unlock_descq_all(descq) \
+	do { \
+		unlock_descq_cmpl(descq); \
+		unlock_descq(descq); \
+	} while (0)
+
+/** the *_fp() entry points trust the handle resolved by
+ *  qdma_queue_fp_hndl(), debug builds check it on every call
+ */
+#ifdef DEBUG
+#define descq_fp_check(descq) \
+	((!(descq) || !(descq)->xdev || \
+	  xdev_check_hndl(__func__, (descq)->xdev->conf.pdev, \
+			  (unsigned long)(descq)->xdev) < 0) ? -EINVAL : 0)
+#else
+#define descq_fp_check(descq)	0
 #endif
 
 static inline unsigned int ring_idx_delta(unsigned int new, unsigned int old,
@@ -230,6 +300,19 @@ static inline unsigned int ring_idx_decr(unsigned int idx, unsigned int cnt,
 	return idx >= cnt ?  idx - cnt : rngsz - (cnt - idx);
 }
 
+/* H2C and MM queues: the completion side only publishes cidx, the producer
+ * recomputes the free descriptors from it, called with the descq lock held
+ */
+static inline unsigned int descq_avail_update(struct qdma_descq *descq)
+{
+	unsigned int cidx = smp_load_acquire(&descq->cidx);
+
+	descq->avail = descq->conf.rngsz - 1 -
+			ring_idx_delta(descq->pidx, cidx, descq->conf.rngsz);
+
+	return descq->avail;
+}
+
 /*****************************************************************************/
 /**
  * qdma_descq_init() - initialize the sw descq entry
@@ -324,6 +407,59 @@ int qdma_descq_context_cleanup(struct qdma_descq *descq);
 int qdma_descq_service_cmpl_update(struct qdma_descq *descq, int budget,
 			bool c2h_upd_cmpl);
 
+/*****************************************************************************/
+/**
+ * descq_c2h_update_pointers() - write the ST C2H cmpt cidx and pidx,
+ *				called with the queue lock held
+ *
+ * @param[in]	descq:		pointer to qdma_descq
+ * @param[in]	irq_arm:	false to keep the completion irq masked
+ *
+ * @return	0 - success, < 0 for failure
+ *****************************************************************************/
+int descq_c2h_update_pointers(struct qdma_descq *descq, bool irq_arm);
+
+/*****************************************************************************/
+/**
+ * qdma_descq_csr_slots_ref() - take or drop the references of a queue on
+ *				the global csr slots indexed by its conf
+ *
+ * @param[in]	descq:		pointer to qdma_descq
+ * @param[in]	hold:		true when the queue starts, false once its
+ *				context is cleared
+ *
+ * @return	none
+ *****************************************************************************/
+void qdma_descq_csr_slots_ref(struct qdma_descq *descq, bool hold);
+
+/*****************************************************************************/
+/**
+ * qdma_descq_csr_slots_move() - set the completion timer and counter
+ *				threshold indexes of conf, moving the slot
+ *				references of a started queue along
+ *
+ * @param[in]	descq:		pointer to qdma_descq
+ * @param[in]	timer_idx:	new global csr timer index
+ * @param[in]	cnt_th_idx:	new global csr counter threshold index
+ *
+ * @return	none
+ *****************************************************************************/
+void qdma_descq_csr_slots_move(struct qdma_descq *descq, u8 timer_idx,
+			       u8 cnt_th_idx);
+
+/*****************************************************************************/
+/**
+ * qdma_descq_cancel_request() - take a request off the queue before it
+ *				completed, called with both descq locks held
+ *
+ * @param[in]	descq:		pointer to qdma_descq
+ * @param[in]	req:		request to be removed
+ *
+ * @return	none
+ *****************************************************************************/
+void qdma_descq_cancel_request(struct qdma_descq *descq,
+				struct qdma_request *req);
+
 /*****************************************************************************/
 /**
  * qdma_descq_dump() - dump the queue sw desciptor data
@@ -394,12 +530,10 @@ void incr_cmpl_desc_cnt(struct qdma_descq *descq, unsigned int cnt);
  * @brief	qdma_sgt_req_cb fits in qdma_request.opaque
  */
 struct qdma_sgt_req_cb {
-	/** qdma read/write request list*/
+	/** ST C2H read request list*/
 	struct list_head list;
 	/** request wait queue */
 	qdma_wait_queue wq;
-	/** number of descriptors to proccess*/
-	unsigned int desc_nr;
 	/** offset in the page*/
 	unsigned int offset;
 	/** offset in the scatter gather list*/
@@ -551,63 +685,42 @@ static inline unsigned int get_next_powof2(unsigned int value)
 	return f_value;
 }
 
-//#define QDMA_SPIN_LOCK_GRANULAR
-
-static inline void qdma_work_queue_add(struct qdma_descq *descq,
+/* the work ring functions are called with the descq lock held */
+static inline int qdma_work_queue_add(struct qdma_descq *descq,
 				struct qdma_sgt_req_cb *cb)
 {
-#ifdef QDMA_SPIN_LOCK_GRANULAR
-	spin_lock_bh(&descq->work_list_lock);
-	list_add_tail(&cb->list, &descq->work_list);
-	descq->work_req_pend++;
-	spin_unlock_bh(&descq->work_list_lock);
-#else
-	list_add_tail(&cb->list, &descq->work_list);
-	descq->work_req_pend++;
-#endif
+	if (unlikely(descq->work_tail - descq->work_head >
+		     descq->work_ring_mask))
+		return -EBUSY;
+
+	descq->work_ring[descq->work_tail++ & descq->work_ring_mask] =
+						(struct qdma_request *)cb;
+	return 0;
 }
 
-static inline void qdma_work_queue_del(struct qdma_descq *descq,
-				struct qdma_sgt_req_cb *cb)
+static inline void qdma_work_queue_pop(struct qdma_descq *descq)
 {
-#ifdef QDMA_SPIN_LOCK_GRANULAR
-	spin_lock_bh(&descq->work_list_lock);
-	list_del(&cb->list);
-	descq->work_req_pend--;
-	spin_unlock_bh(&descq->work_list_lock);
-#else
-	list_del(&cb->list);
-	descq->work_req_pend--;
-#endif
+	descq->work_ring[descq->work_head++ & descq->work_ring_mask] = NULL;
 }
 
 static inline int qdma_work_queue_len(struct qdma_descq *descq)
 {
-	int count = 0;
-
-#ifdef QDMA_SPIN_LOCK_GRANULAR
-	spin_lock_bh(&descq->work_list_lock);
-	count = descq->work_req_pend;
-	spin_unlock_bh(&descq->work_list_lock);
-#else
-	count = descq->work_req_pend;
-#endif
-	return count;
+	return descq->work_tail - descq->work_head;
 }
 
+/* skips the requests cancelled while on the ring */
 static inline struct qdma_request *qdma_work_queue_first_entry(
 			struct qdma_descq *descq)
 {
 	struct qdma_request *req;
-#ifdef QDMA_SPIN_LOCK_GRANULAR
-	spin_lock_bh(&descq->work_list_lock);
-	req = (struct qdma_request *) list_first_entry(&descq->work_list,
-					struct qdma_sgt_req_cb, list);
-	spin_unlock_bh(&descq->work_list_lock);
-#else
-	req = (struct qdma_request *) list_first_entry(&descq->work_list,
-						struct qdma_sgt_req_cb, list);
-#endif
-	return req;
+
+	for (; descq->work_head != descq->work_tail; descq->work_head++) {
+		req = descq->work_ring[descq->work_head &
+				       descq->work_ring_mask];
+		if (likely(req))
+			return req;
+	}
+
+	return NULL;
 }
 #endif /* ifndef __QDMA_DESCQ_H__ */
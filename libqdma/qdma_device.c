@@ -236,7 +236,8 @@ int qdma_device_init(struct xlnx_dma_dev *xdev)
 
 	memset(&fmap, 0, sizeof(struct qdma_fmap_cfg));
 
-	qdev = kzalloc(sizeof(struct qdma_dev) +
+	/* the descqs start on a cache line, their hot sections rely on it */
+	qdev = kzalloc(ALIGN(sizeof(struct qdma_dev), SMP_CACHE_BYTES) +
 			sizeof(struct qdma_descq) * qmax * 3, GFP_KERNEL);
 	if (!qdev) {
 		pr_err("dev %s qmax %d OOM.\n",
@@ -257,7 +258,8 @@ int qdma_device_init(struct xlnx_dma_dev *xdev)
 	}
 #endif
 
-	descq = (struct qdma_descq *)(qdev + 1);
+	descq = (struct qdma_descq *)((u8 *)qdev +
+			ALIGN(sizeof(struct qdma_dev), SMP_CACHE_BYTES));
 	qdev->h2c_descq = descq;
 	qdev->c2h_descq = descq + qmax;
 	qdev->cmpt_descq = descq + (2 * qmax);
@@ -274,7 +276,12 @@ int qdma_device_init(struct xlnx_dma_dev *xdev)
 	for (i = 0, descq = qdev->cmpt_descq; i < qdev->qmax; i++, descq++)
 		qdma_descq_init(descq, xdev, i, i);
 #ifndef __QDMA_VF__
-	xdev->hw.qdma_set_default_global_csr(xdev);
+	/** the other functions of the device may run queues on the slots */
+	if (!qdma_dev_csr_slots_in_use(xdev->dma_device_index))
+		xdev->hw.qdma_set_default_global_csr(xdev);
+	else
+		pr_info("%s: global csr in use, keeping the programmed values\n",
+			xdev->conf.name);
 	for (i = 0; i < xdev->dev_cap.mm_channel_max; i++) {
 		xdev->hw.qdma_mm_channel_conf(xdev, i, 1, 1);
 		xdev->hw.qdma_mm_channel_conf(xdev, i, 0, 1);
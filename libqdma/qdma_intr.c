@@ -20,6 +20,7 @@
 #define pr_fmt(fmt)	KBUILD_MODNAME ":%s: " fmt, __func__
 
 #include <linux/kernel.h>
+#include <linux/rcupdate.h>
 #include "qdma_descq.h"
 #include "qdma_device.h"
 #include "qdma_regs.h"
@@ -145,6 +146,21 @@ static irqreturn_t error_intr_handler(int irq_index, int irq, void *dev_id)
 }
 #endif
 
+/*
+ * the cpu picked by qdma_thread_add_work() may have gone offline since,
+ * let the workqueue choose one in that case
+ */
+static inline void descq_schedule_work(struct qdma_descq *descq)
+{
+	int cpu = WORK_CPU_UNBOUND;
+
+	if (descq->cpu_assigned && cpu_online(descq->intr_work_cpu))
+		cpu = descq->intr_work_cpu;
+
+	qdma_wq_queue_work(&descq->xdev->dp_wq, cpu, &descq->work,
+			   &descq->work_qtime);
+}
+
 static void data_intr_aggregate(struct xlnx_dma_dev *xdev, int vidx, int irq,
 		u64 timestamp)
 {
@@ -229,18 +245,13 @@ static void data_intr_aggregate(struct xlnx_dma_dev *xdev, int vidx, int irq,
 			descq->conf.fp_descq_isr_top(descq->q_hndl,
 					descq->conf.quld);
 		} else {
-			if (descq->cpu_assigned)
-				schedule_work_on(descq->intr_work_cpu,
-						&descq->work);
-			else
-				schedule_work(&descq->work);
+			descq_schedule_work(descq);
 		}
 
 		if (++intr_cidx_info->sw_cidx ==
 				coal_entry->intr_rng_num_entries) {
 			counter = 0;
-			xdev->intr_coal_list->color =
-				(xdev->intr_coal_list->color) ? 0 : 1;
+			coal_entry->color = coal_entry->color ? 0 : 1;
 			intr_cidx_info->sw_cidx = 0;
 		} else
 			counter++;
@@ -263,20 +274,102 @@ static void data_intr_aggregate(struct xlnx_dma_dev *xdev, int vidx, int irq,
 
 }
 
+static struct intr_q_tbl *intr_q_tbl_alloc(struct intr_q_tbl *old,
+					    struct qdma_descq *add,
+					    struct qdma_descq *del)
+{
+	struct intr_q_tbl *tbl;
+	int cnt = add ? 1 : 0;
+	int i;
+
+	for (i = 0; old && i < old->cnt; i++)
+		if (old->descq[i] && old->descq[i] != del)
+			cnt++;
+	if (!cnt)
+		return NULL;
+
+	tbl = kzalloc(sizeof(*tbl) + cnt * sizeof(tbl->descq[0]), GFP_ATOMIC);
+	if (!tbl)
+		return ERR_PTR(-ENOMEM);
+
+	for (i = 0; old && i < old->cnt; i++)
+		if (old->descq[i] && old->descq[i] != del)
+			tbl->descq[tbl->cnt++] = old->descq[i];
+	if (add)
+		tbl->descq[tbl->cnt++] = add;
+
+	return tbl;
+}
+
+int intr_q_tbl_add(struct qdma_descq *descq)
+{
+	struct intr_info_t *info =
+			&descq->xdev->dev_intr_info_list[descq->intr_id];
+	struct intr_q_tbl *old, *tbl;
+	unsigned long flags;
+
+	spin_lock_irqsave(&info->vec_q_list, flags);
+	old = rcu_dereference_protected(info->q_tbl,
+					lockdep_is_held(&info->vec_q_list));
+	tbl = intr_q_tbl_alloc(old, descq, NULL);
+	if (IS_ERR(tbl)) {
+		spin_unlock_irqrestore(&info->vec_q_list, flags);
+		return PTR_ERR(tbl);
+	}
+	rcu_assign_pointer(info->q_tbl, tbl);
+	info->intr_list_cnt++;
+	spin_unlock_irqrestore(&info->vec_q_list, flags);
+
+	if (old)
+		kfree_rcu(old, rcu);
+
+	return 0;
+}
+
+void intr_q_tbl_del(struct qdma_descq *descq)
+{
+	struct intr_info_t *info =
+			&descq->xdev->dev_intr_info_list[descq->intr_id];
+	struct intr_q_tbl *old, *tbl;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&info->vec_q_list, flags);
+	old = rcu_dereference_protected(info->q_tbl,
+					lockdep_is_held(&info->vec_q_list));
+	tbl = intr_q_tbl_alloc(old, NULL, descq);
+	if (IS_ERR(tbl)) {
+		/* keep the table, the handler skips empty slots */
+		for (i = 0; old && i < old->cnt; i++)
+			if (old->descq[i] == descq)
+				WRITE_ONCE(old->descq[i], NULL);
+		old = NULL;
+	} else {
+		rcu_assign_pointer(info->q_tbl, tbl);
+	}
+	info->intr_list_cnt--;
+	spin_unlock_irqrestore(&info->vec_q_list, flags);
+
+	/* no grace period per queue, qdma_queue_remove() waits for one */
+	descq->intr_tbl_gp = get_state_synchronize_rcu();
+	if (old)
+		kfree_rcu(old, rcu);
+}
+
 static void data_intr_direct(struct xlnx_dma_dev *xdev, int vidx, int irq,
 			u64 timestamp)
 {
 	struct qdma_descq *descq;
-	unsigned long flags;
-	struct list_head *descq_list =
-			&xdev->dev_intr_info_list[vidx].intr_list;
-	struct list_head *entry, *tmp;
+	struct intr_q_tbl *tbl;
+	int i;
 
-	spin_lock_irqsave(&xdev->dev_intr_info_list[vidx].vec_q_list,
-			  flags);
-	list_for_each_safe(entry, tmp, descq_list) {
-		descq = container_of(entry, struct qdma_descq, intr_list);
-		if (!descq)
+	/* no lock and no search: the vector's queues are read under rcu */
+	rcu_read_lock();
+	tbl = rcu_dereference(xdev->dev_intr_info_list[vidx].q_tbl);
+	for (i = 0; tbl && i < tbl->cnt; i++) {
+		descq = READ_ONCE(tbl->descq[i]);
+		/* a stopped queue may be seen until the next grace period */
+		if (!descq || READ_ONCE(descq->q_state) != Q_STATE_ONLINE)
 			continue;
 
 		if (descq->conf.ping_pong_en &&
@@ -287,15 +380,10 @@ static void data_intr_direct(struct xlnx_dma_dev *xdev, int vidx, int irq,
 			descq->conf.fp_descq_isr_top(descq->q_hndl,
 					descq->conf.quld);
 		} else {
-			if (descq->cpu_assigned)
-				schedule_work_on(descq->intr_work_cpu,
-						&descq->work);
-			else
-				schedule_work(&descq->work);
+			descq_schedule_work(descq);
 		}
 	}
-	spin_unlock_irqrestore(&xdev->dev_intr_info_list[vidx].vec_q_list,
-			    flags);
+	rcu_read_unlock();
 }
 
 static irqreturn_t data_intr_handler(int vector_index, int irq, void *dev_id)
@@ -361,9 +449,9 @@ static void intr_context_invalidate(struct xlnx_dma_dev *xdev)
 	if (!m)
 		return;
 	memset(&ictxt, 0, sizeof(struct mbox_msg_intr_ctxt));
-	ictxt.num_rings = QDMA_NUM_DATA_VEC_FOR_INTR_CXT;
+	ictxt.num_rings = xdev->intr_ring_cnt;
 
-	for (i = 0; i < QDMA_NUM_DATA_VEC_FOR_INTR_CXT; i++) {
+	for (i = 0; i < xdev->intr_ring_cnt; i++) {
 		ictxt.ring_index_list[i] =
 			get_intr_ring_index(xdev, xdev->dvec_start_idx + i);
 	}
@@ -377,7 +465,7 @@ static void intr_context_invalidate(struct xlnx_dma_dev *xdev)
 
 	qdma_mbox_msg_free(m);
 
-	for (i = 0; i < QDMA_NUM_DATA_VEC_FOR_INTR_CXT; i++) {
+	for (i = 0; i < xdev->intr_ring_cnt; i++) {
 		ring_entry = (xdev->intr_coal_list + i);
 		if (ring_entry) {
 			intr_ring_free(xdev,
@@ -397,7 +485,7 @@ static void intr_context_invalidate(struct xlnx_dma_dev *xdev)
 	struct intr_coal_conf  *ring_entry;
 	int rv = 0;
 
-	while (i < QDMA_NUM_DATA_VEC_FOR_INTR_CXT) {
+	while (i < xdev->intr_ring_cnt) {
 		ring_index = get_intr_ring_index(xdev,
 				(i + xdev->dvec_start_idx));
 		rv = xdev->hw.qdma_indirect_intr_ctx_conf(xdev, ring_index,
@@ -427,28 +515,29 @@ void intr_ring_teardown(struct xlnx_dma_dev *xdev)
 	kfree(xdev->intr_coal_list);
 }
 
-static void data_vector_handler(int irq, struct xlnx_dma_dev *xdev)
+/* MSI-X vectors are requested with their intr_info_t as dev_id */
+static irqreturn_t irq_vector(int irq, void *dev_id)
 {
-	int i;
+	struct intr_info_t *info = dev_id;
 
-	for (i = 0; i < xdev->num_vecs; i++) {
-		if (xdev->msix[i].vector == irq) {
-			xdev->dev_intr_info_list[i].intr_vec_map.intr_handler(i,
-					irq, (void *)xdev);
-			break;
-		}
-	}
+	return info->intr_vec_map.intr_handler(
+			info->intr_vec_map.intr_vec_index, irq, info->xdev);
 }
 
-static irqreturn_t irq_bottom(int irq, void *dev_id)
+static irqreturn_t irq_vector_top(int irq, void *dev_id)
 {
-	struct xlnx_dma_dev *xdev = dev_id;
+	struct intr_info_t *info = dev_id;
+	struct xlnx_dma_dev *xdev = info->xdev;
 
-	data_vector_handler(irq, xdev);
+	if (xdev->conf.fp_q_isr_top_dev) {
+		xdev->conf.fp_q_isr_top_dev((unsigned long)xdev,
+					xdev->conf.uld);
+	}
 
-	return IRQ_HANDLED;
+	return IRQ_WAKE_THREAD;
 }
 
+#ifndef __QDMA_VF__
 static irqreturn_t irq_top(int irq, void *dev_id)
 {
 	struct xlnx_dma_dev *xdev = dev_id;
@@ -460,14 +549,14 @@ static irqreturn_t irq_top(int irq, void *dev_id)
 
 	return IRQ_WAKE_THREAD;
 }
-
+#endif
 
 void intr_teardown(struct xlnx_dma_dev *xdev)
 {
 	int i = xdev->num_vecs;
 
 	while (--i >= 0)
-		free_irq(xdev->msix[i].vector, xdev);
+		free_irq(xdev->msix[i].vector, &xdev->dev_intr_info_list[i]);
 
 	if (xdev->num_vecs)
 		pci_disable_msix(xdev->conf.pdev);
@@ -510,13 +599,14 @@ static int intr_vector_setup(struct xlnx_dma_dev *xdev, int idx,
 	xdev->dev_intr_info_list[idx].intr_vec_map.intr_handler = handler;
 
 	if ((type == INTR_TYPE_DATA) || (type == INTR_TYPE_MBOX)) {
-		rv = request_irq(xdev->msix[idx].vector, irq_bottom, 0,
-				 xdev->dev_intr_info_list[idx].msix_name, xdev);
+		rv = request_irq(xdev->msix[idx].vector, irq_vector, 0,
+				 xdev->dev_intr_info_list[idx].msix_name,
+				 &xdev->dev_intr_info_list[idx]);
 	} else
-		rv = request_threaded_irq(xdev->msix[idx].vector, irq_top,
-					  irq_bottom, 0,
+		rv = request_threaded_irq(xdev->msix[idx].vector,
+					  irq_vector_top, irq_vector, 0,
 				  xdev->dev_intr_info_list[idx].msix_name,
-				  xdev);
+				  &xdev->dev_intr_info_list[idx]);
 
 	pr_debug("%s requesting IRQ vector #%d: vec %d, type %d, %s.\n",
 			xdev->conf.name, idx, xdev->msix[idx].vector,
@@ -575,6 +665,21 @@ int intr_setup(struct xlnx_dma_dev *xdev)
 		return -EINVAL;
 	}
 
+	/** indirect mode sets up one interrupt aggregation ring per
+	 *  data vector
+	 */
+	if (((xdev->conf.qdma_drv_mode == INDIRECT_INTR_MODE) ||
+			(xdev->conf.qdma_drv_mode == AUTO_MODE)) &&
+			(xdev->conf.data_msix_qvec_max >
+			 QDMA_INTR_RING_PER_FUNC_MAX)) {
+		pr_info("dev %s supports only (%u) data vectors in %s mode. ignoring input for (%u) vectors",
+			dev_name(&xdev->conf.pdev->dev),
+			QDMA_INTR_RING_PER_FUNC_MAX,
+			mode_name_list[xdev->conf.qdma_drv_mode].name,
+			xdev->conf.data_msix_qvec_max);
+		xdev->conf.data_msix_qvec_max = QDMA_INTR_RING_PER_FUNC_MAX;
+	}
+
 	xdev->num_vecs = min_t(int, num_vecs, xdev->conf.msix_qvec_max);
 	if (xdev->num_vecs < xdev->conf.msix_qvec_max)
 		pr_info("current device supports only (%u) msix vectors per function. ignoring input for (%u) vectors",
@@ -631,7 +736,7 @@ int intr_setup(struct xlnx_dma_dev *xdev)
 
 	for (i = 0; i < xdev->num_vecs; i++) {
 		xdev->msix[i].entry = i;
-		INIT_LIST_HEAD(&xdev->dev_intr_info_list[i].intr_list);
+		xdev->dev_intr_info_list[i].xdev = xdev;
 		spin_lock_init(&xdev->dev_intr_info_list[i].vec_q_list);
 	}
 
@@ -702,7 +807,7 @@ int intr_setup(struct xlnx_dma_dev *xdev)
 
 cleanup_irq:
 	while (--i >= 0)
-		free_irq(xdev->msix[i].vector, xdev);
+		free_irq(xdev->msix[i].vector, &xdev->dev_intr_info_list[i]);
 
 	pci_disable_msix(xdev->conf.pdev);
 	xdev->num_vecs = 0;
@@ -858,20 +963,22 @@ int intr_ring_setup(struct xlnx_dma_dev *xdev)
 		 * Initially assuming that each vector has the same size of the
 		 * ring, In practical it is possible to have different ring
 		 * size of different vectors (?)
+		 * Every data vector gets its own ring, the queues are spread
+		 * over the vectors by desc_alloc_irq()
 		 */
 		intr_coal_list = kzalloc(
 				sizeof(struct intr_coal_conf) *
-				QDMA_NUM_DATA_VEC_FOR_INTR_CXT,
+				xdev->conf.data_msix_qvec_max,
 				GFP_KERNEL);
 		if (!intr_coal_list) {
 			pr_err("dev %s num_vecs %d OOM.\n",
 				dev_name(&xdev->conf.pdev->dev),
-				QDMA_NUM_DATA_VEC_FOR_INTR_CXT);
+				xdev->conf.data_msix_qvec_max);
 			return -ENOMEM;
 		}
 
 		for (counter = 0;
-			counter < QDMA_NUM_DATA_VEC_FOR_INTR_CXT;
+			counter < xdev->conf.data_msix_qvec_max;
 			counter++) {
 			intr_coal_list_entry = (intr_coal_list + counter);
 			intr_coal_list_entry->intr_rng_num_entries =
@@ -904,6 +1011,7 @@ int intr_ring_setup(struct xlnx_dma_dev *xdev)
 					dev_name(&xdev->conf.pdev->dev));
 
 		xdev->intr_coal_list = intr_coal_list;
+		xdev->intr_ring_cnt = xdev->conf.data_msix_qvec_max;
 	} else {
 		pr_info("dev %s intr vec[%d] >= queues[%d], No aggregation\n",
 			dev_name(&xdev->conf.pdev->dev),
@@ -911,6 +1019,7 @@ int intr_ring_setup(struct xlnx_dma_dev *xdev)
 			xdev->conf.qsets_max);
 
 		xdev->intr_coal_list = NULL;
+		xdev->intr_ring_cnt = 0;
 		/* Fallback from indirect interrupt mode */
 		xdev->conf.qdma_drv_mode = POLL_MODE;
 	}
@@ -928,11 +1037,25 @@ err_out:
 	return -ENOMEM;
 }
 
+enum hrtimer_restart intr_h2c_timer(struct hrtimer *timer)
+{
+	struct qdma_descq *descq = container_of(timer, struct qdma_descq,
+						h2c_irq_timer);
+
+	if (descq->conf.fp_descq_isr_top)
+		descq->conf.fp_descq_isr_top(descq->q_hndl, descq->conf.quld);
+	else
+		descq_schedule_work(descq);
+
+	return HRTIMER_NORESTART;
+}
+
 void intr_work(struct work_struct *work)
 {
 	struct qdma_descq *descq;
 
 	descq = container_of(work, struct qdma_descq, work);
+	qdma_wq_work_start(&descq->xdev->dp_wq, descq->work_qtime);
 	qdma_descq_service_cmpl_update(descq, 0, 1);
 }
 
@@ -962,12 +1085,20 @@ int qdma_queue_service(unsigned long dev_hndl, unsigned long id, int budget,
 
 	descq = qdma_device_get_descq_by_id(xdev, id, NULL, 0, 0);
 	if (descq)
-		return qdma_descq_service_cmpl_update(descq,
-					budget, c2h_upd_cmpl);
+		return qdma_queue_service_fp(descq, budget, c2h_upd_cmpl);
 
 	return -EINVAL;
 }
 
+int qdma_queue_service_fp(struct qdma_descq *descq, int budget,
+			  bool c2h_upd_cmpl)
+{
+	if (unlikely(descq_fp_check(descq) < 0))
+		return -EINVAL;
+
+	return qdma_descq_service_cmpl_update(descq, budget, c2h_upd_cmpl);
+}
+
 static u8 get_intr_vec_index(struct xlnx_dma_dev *xdev, u8 intr_type)
 {
 	int i = 0;
@@ -1002,10 +1133,19 @@ int qdma_err_intr_setup(struct xlnx_dma_dev *xdev)
 
 int get_intr_ring_index(struct xlnx_dma_dev *xdev, u32 vector_index)
 {
+	int ring = vector_index - xdev->dvec_start_idx;
 	int ring_index = 0;
 
-	ring_index = (vector_index - xdev->dvec_start_idx) +
+	if (ring < QDMA_NUM_DATA_VEC_FOR_INTR_CXT)
+		ring_index = ring +
 			(xdev->func_id * QDMA_NUM_DATA_VEC_FOR_INTR_CXT);
+	else
+		/* the extra rings follow the first ones of all functions */
+		ring_index = (QDMA_INTR_RING_FUNC_MAX *
+			      QDMA_NUM_DATA_VEC_FOR_INTR_CXT) +
+			(xdev->func_id * (QDMA_NUM_DATA_VEC_FOR_INTR_MAX -
+					  QDMA_NUM_DATA_VEC_FOR_INTR_CXT)) +
+			(ring - QDMA_NUM_DATA_VEC_FOR_INTR_CXT);
 	pr_debug("func_id = %d, vector_index = %d, ring_index = %d\n",
 			xdev->func_id, vector_index, ring_index);
 
@@ -26,12 +26,22 @@
  */
 #include <linux/types.h>
 #include <linux/workqueue.h>
+#include <linux/rcupdate.h>
 #include "qdma_descq.h"
 /**
  * forward declaration for xlnx_dma_dev
  */
 struct xlnx_dma_dev;
 
+/**
+ * maximum data vectors, one interrupt aggregation ring each, of the function
+ */
+#ifdef __QDMA_VF__
+#define QDMA_INTR_RING_PER_FUNC_MAX	QDMA_NUM_DATA_VEC_FOR_INTR_CXT
+#else
+#define QDMA_INTR_RING_PER_FUNC_MAX	QDMA_NUM_DATA_VEC_FOR_INTR_MAX
+#endif
+
 /**
  * @struct - qdma_intr_ring_cpm
  * @brief	Interrupt ring entry definition for 2018.2 CPM release
@@ -198,6 +208,43 @@ int intr_legacy_setup(struct qdma_descq *descq);
 void intr_legacy_clear(struct qdma_descq *descq);
 
 
+/*****************************************************************************/
+/**
+ * intr_q_tbl_add() - add a queue to the queue table of its vector
+ *
+ * @param[in]	descq:		pointer to qdma_descq
+ *
+ * @return	0: success
+ * @return	<0: failure
+ *****************************************************************************/
+int intr_q_tbl_add(struct qdma_descq *descq);
+
+/*****************************************************************************/
+/**
+ * intr_q_tbl_del() - remove a queue from the queue table of its vector,
+ *			handlers may still use it until intr_q_tbl_sync()
+ *
+ * @param[in]	descq:		pointer to qdma_descq
+ *
+ * @return	none
+ *****************************************************************************/
+void intr_q_tbl_del(struct qdma_descq *descq);
+
+/*****************************************************************************/
+/**
+ * intr_q_tbl_sync() - wait for the interrupt handlers that may still use a
+ *			queue removed by intr_q_tbl_del(). A grace period
+ *			already elapsed for an earlier queue covers it.
+ *
+ * @param[in]	descq:		pointer to qdma_descq
+ *
+ * @return	none
+ *****************************************************************************/
+static inline void intr_q_tbl_sync(struct qdma_descq *descq)
+{
+	cond_synchronize_rcu(descq->intr_tbl_gp);
+}
+
 /*****************************************************************************/
 /**
  * intr_work() - attach the top half for the interrupt
@@ -208,6 +255,17 @@ void intr_legacy_clear(struct qdma_descq *descq);
  *****************************************************************************/
 void intr_work(struct work_struct *work);
 
+/*****************************************************************************/
+/**
+ * intr_h2c_timer() - service an H2C queue whose interrupt is not armed, as
+ *			its interrupt would
+ *
+ * @param[in]	timer:		pointer to the h2c_irq_timer of the queue
+ *
+ * @return	HRTIMER_NORESTART
+ *****************************************************************************/
+enum hrtimer_restart intr_h2c_timer(struct hrtimer *timer);
+
 /*****************************************************************************/
 /**
  * qdma_err_intr_setup() - set up the error interrupt
@@ -49,6 +49,7 @@ static struct err_code_map error_code_map_list[] = {
 	{QDMA_ERR_MBOX_NO_MSG_IN,		EINVAL},
 	{QDMA_ERR_MBOX_REG_READ_FAILED,	EIO},
 	{QDMA_ERR_MBOX_ALL_ZERO_MSG,		EINVAL},
+	{QDMA_ERR_RM_NO_CSR_SLOT_LEFT,		ENOSPC},
 };
 
 /**
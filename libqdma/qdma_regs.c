@@ -23,6 +23,7 @@
 
 #include <linux/version.h>
 #include <linux/delay.h>
+#include <linux/mutex.h>
 #include <linux/printk.h>
 #include <linux/stddef.h>
 #include <linux/string.h>
@@ -373,6 +374,188 @@ int qdma_global_csr_get(unsigned long dev_hndl, u8 index, u8 count,
 	return 0;
 }
 
+#ifdef __QDMA_VF__
+int qdma_global_csr_slot_get(unsigned long dev_hndl,
+		enum qdma_global_csr_type csr_type, unsigned int value,
+		u8 *index)
+{
+	return -EOPNOTSUPP;
+}
+
+int qdma_global_csr_slot_put(unsigned long dev_hndl,
+		enum qdma_global_csr_type csr_type, u8 index)
+{
+	return -EOPNOTSUPP;
+}
+
+/* the PF takes the references of VF queues when it writes their contexts */
+void qdma_descq_csr_slots_ref(struct qdma_descq *descq, bool hold)
+{
+}
+
+void qdma_descq_csr_slots_move(struct qdma_descq *descq, u8 timer_idx,
+			       u8 cnt_th_idx)
+{
+	descq->conf.cmpl_timer_idx = timer_idx;
+	descq->conf.cmpl_cnt_th_idx = cnt_th_idx;
+}
+#else
+/* serializes the slot assignment with the programming of the slot */
+static DEFINE_MUTEX(csr_slot_lock);
+
+int qdma_global_csr_slot_get(unsigned long dev_hndl,
+		enum qdma_global_csr_type csr_type, unsigned int value,
+		u8 *index)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	u32 hw_values[QDMA_GLOBAL_CSR_ARRAY_SZ];
+	u8 slot;
+	int rv;
+
+	if (!xdev || !index)
+		return -EINVAL;
+
+	if (xdev_check_hndl(__func__, xdev->conf.pdev, dev_hndl) < 0)
+		return -EINVAL;
+
+	if (csr_type >= QDMA_CSR_MAX)
+		return -EINVAL;
+
+	/** The hardware ring size includes the wrap around descriptor and
+	 *  status descriptor, see qdma_global_csr_get()
+	 */
+	if (csr_type == QDMA_CSR_RING_SZ)
+		value++;
+
+	mutex_lock(&csr_slot_lock);
+	rv = xdev->hw.qdma_global_csr_conf(xdev, 0, QDMA_GLOBAL_CSR_ARRAY_SZ,
+				hw_values, csr_type, QDMA_HW_ACCESS_READ);
+	if (rv < 0) {
+		pr_err("%s: Failed to read global csr %d, err = %d",
+				xdev->conf.name, csr_type, rv);
+		rv = xdev->hw.qdma_get_error_code(rv);
+		goto unlock;
+	}
+
+	rv = qdma_dev_csr_slot_get(xdev->dma_device_index, xdev->func_id,
+				csr_type, hw_values, value, &slot);
+	if (rv < 0) {
+		rv = xdev->hw.qdma_get_error_code(rv);
+		goto unlock;
+	}
+
+	if (rv > 0) {
+		/** no started queue of any function uses the slot */
+		rv = xdev->hw.qdma_global_csr_conf(xdev, slot, 1, &value,
+					csr_type, QDMA_HW_ACCESS_WRITE);
+		if (rv < 0) {
+			pr_err("%s: Failed to write global csr %d[%u], err = %d",
+					xdev->conf.name, csr_type, slot, rv);
+			qdma_dev_csr_slot_put(xdev->dma_device_index,
+					xdev->func_id, csr_type, slot);
+			rv = xdev->hw.qdma_get_error_code(rv);
+			goto unlock;
+		}
+		xdev_list_csr_sync(xdev->dma_device_index);
+		pr_debug("%s: global csr %d[%u] set to %u\n",
+				xdev->conf.name, csr_type, slot, value);
+	}
+
+	*index = slot;
+unlock:
+	mutex_unlock(&csr_slot_lock);
+	return rv;
+}
+
+int qdma_global_csr_slot_put(unsigned long dev_hndl,
+		enum qdma_global_csr_type csr_type, u8 index)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	int rv;
+
+	if (!xdev)
+		return -EINVAL;
+
+	if (xdev_check_hndl(__func__, xdev->conf.pdev, dev_hndl) < 0)
+		return -EINVAL;
+
+	mutex_lock(&csr_slot_lock);
+	rv = qdma_dev_csr_slot_put(xdev->dma_device_index, xdev->func_id,
+				   csr_type, index);
+	mutex_unlock(&csr_slot_lock);
+	if (rv < 0)
+		return xdev->hw.qdma_get_error_code(rv);
+
+	return 0;
+}
+
+static void descq_csr_slot_ref(struct xlnx_dma_dev *xdev,
+		enum qdma_global_csr_type csr_type, u8 slot, bool hold)
+{
+	if (hold)
+		qdma_dev_csr_slot_hold(xdev->dma_device_index, xdev->func_id,
+				       csr_type, slot);
+	else
+		qdma_dev_csr_slot_put(xdev->dma_device_index, xdev->func_id,
+				      csr_type, slot);
+}
+
+void qdma_descq_csr_slots_ref(struct qdma_descq *descq, bool hold)
+{
+	struct xlnx_dma_dev *xdev = descq->xdev;
+	struct qdma_queue_conf *qconf = &descq->conf;
+
+	mutex_lock(&csr_slot_lock);
+	if (descq->csr_slots_held == hold) {
+		mutex_unlock(&csr_slot_lock);
+		return;
+	}
+
+	if (qconf->q_type != Q_CMPT)
+		descq_csr_slot_ref(xdev, QDMA_CSR_RING_SZ,
+				   qconf->desc_rng_sz_idx, hold);
+	if (qconf->st && (qconf->q_type == Q_C2H))
+		descq_csr_slot_ref(xdev, QDMA_CSR_BUF_SZ,
+				   qconf->c2h_buf_sz_idx, hold);
+	if ((qconf->st && (qconf->q_type == Q_C2H)) ||
+	    (!qconf->st && (qconf->q_type == Q_CMPT))) {
+		descq_csr_slot_ref(xdev, QDMA_CSR_RING_SZ,
+				   qconf->cmpl_rng_sz_idx, hold);
+		descq_csr_slot_ref(xdev, QDMA_CSR_TIMER_CNT,
+				   qconf->cmpl_timer_idx, hold);
+		/* adaptive_rx moves the threshold to any slot */
+		descq_csr_slot_ref(xdev, QDMA_CSR_CNT_TH,
+				   qconf->adaptive_rx ? QDMA_CSR_SLOT_ANY :
+				   qconf->cmpl_cnt_th_idx, hold);
+	}
+	descq->csr_slots_held = hold;
+	mutex_unlock(&csr_slot_lock);
+}
+
+void qdma_descq_csr_slots_move(struct qdma_descq *descq, u8 timer_idx,
+			       u8 cnt_th_idx)
+{
+	struct xlnx_dma_dev *xdev = descq->xdev;
+	struct qdma_queue_conf *qconf = &descq->conf;
+
+	mutex_lock(&csr_slot_lock);
+	if (descq->csr_slots_held) {
+		descq_csr_slot_ref(xdev, QDMA_CSR_TIMER_CNT, timer_idx, true);
+		descq_csr_slot_ref(xdev, QDMA_CSR_TIMER_CNT,
+				   qconf->cmpl_timer_idx, false);
+		if (!qconf->adaptive_rx) {
+			descq_csr_slot_ref(xdev, QDMA_CSR_CNT_TH, cnt_th_idx,
+					   true);
+			descq_csr_slot_ref(xdev, QDMA_CSR_CNT_TH,
+					   qconf->cmpl_cnt_th_idx, false);
+		}
+	}
+	qconf->cmpl_timer_idx = timer_idx;
+	qconf->cmpl_cnt_th_idx = cnt_th_idx;
+	mutex_unlock(&csr_slot_lock);
+}
+#endif
+
 int qdma_device_flr_quirk_set(struct pci_dev *pdev, unsigned long dev_hndl)
 {
 	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
@@ -555,6 +738,9 @@ int qdma_queue_cmpl_ctrl(unsigned long dev_hndl, unsigned long id,
 	}
 
 	if (set) {
+		/** the started queue moves its references with the indexes */
+		qdma_descq_csr_slots_move(descq, cctrl->timer_idx,
+					  cctrl->cnt_th_idx);
 		lock_descq(descq);
 
 		descq->cmpt_cidx_info.trig_mode =
@@ -602,3 +788,44 @@ int qdma_queue_cmpl_ctrl(unsigned long dev_hndl, unsigned long id,
 
 	return 0;
 }
+
+int qdma_queue_h2c_irq_moder(unsigned long dev_hndl, unsigned long id,
+			unsigned int frames, unsigned int usecs)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_descq *descq;
+
+	/** make sure that the dev_hndl passed is Valid */
+	if (!xdev) {
+		pr_err("dev_hndl is NULL");
+		return -EINVAL;
+	}
+
+	if (xdev_check_hndl(__func__, xdev->conf.pdev, dev_hndl) < 0) {
+		pr_err("Invalid dev_hndl passed");
+		return -EINVAL;
+	}
+
+	descq = qdma_device_get_descq_by_id(xdev, id, NULL, 0, 1);
+	if (!descq) {
+		pr_err("Invalid qid: %ld", id);
+		return -EINVAL;
+	}
+
+	if (!descq->conf.st || descq->conf.q_type != Q_H2C ||
+	    !descq->conf.irq_en)
+		return -EOPNOTSUPP;
+
+	/** without the timer, the last descriptors could wait forever */
+	if (frames > 1 && !usecs)
+		return -EINVAL;
+
+	lock_descq(descq);
+	descq->h2c_irq_frames = (frames > 1) ? frames : 0;
+	descq->h2c_irq_usecs = usecs;
+	if (!descq->h2c_irq_frames)
+		descq->pidx_info.irq_en = descq->conf.irq_en;
+	unlock_descq(descq);
+
+	return 0;
+}
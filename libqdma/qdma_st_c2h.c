@@ -37,10 +37,18 @@
 #include "qdma_ul_ext.h"
 #include "version.h"
 
+#define CREATE_TRACE_POINTS
+#include "qdma_trace.h"
+
 /*
  * ST C2H descq (i.e., freelist) RX buffers
  */
 
+/* the deferred refill is kicked once fewer than size >> shift descriptors
+ * are available to the hardware
+ */
+#define QDMA_FLQ_LOW_WM_SHIFT	2
+
 static inline void flq_free_one(struct qdma_sw_sg *sdesc,
 					struct qdma_c2h_desc *desc)
 {
@@ -89,11 +97,15 @@ static inline int flq_fill_one(struct qdma_descq *descq,
 	}
 
 	pg_sdesc = flq->pg_sdesc + pg_idx;
-	if (!pg_sdesc || !pg_sdesc->pg_base) {
+	if (!pg_sdesc) {
 		pr_err("%s: pg_sdesc is NULL", __func__);
 		return -EINVAL;
 	}
 
+	/* page could not be replaced at recycle time, wait for the refill */
+	if (!pg_sdesc->pg_base)
+		return -ENOMEM;
+
 	if (pg_sdesc->pg_offset + buf_sz > flq->max_pg_offset) {
 		pr_err("%s: memory full, alloc_idx %u, recycle_idx = %u offset = %u, pg_idx = %u",
 				__func__,
@@ -344,6 +356,24 @@ int descq_flq_alloc_resource(struct qdma_descq *descq)
 	return 0;
 }
 
+/* a page can be handed out again as is once the stack released every
+ * slice of it, i.e. only the reference taken at allocation is left
+ */
+static inline bool flq_page_reusable(struct page *pg, int node)
+{
+#if KERNEL_VERSION(4, 6, 0) < LINUX_VERSION_CODE
+	if (page_ref_count(pg) != 1)
+		return false;
+#else
+	if (atomic_read(&pg->_count) != 1)
+		return false;
+#endif
+	if ((node != NUMA_NO_NODE) && (page_to_nid(pg) != node))
+		return false;
+
+	return !page_is_pfmemalloc(pg);
+}
+
 static inline int flq_refill_pages(struct qdma_descq *descq,
 		int count, bool recycle, gfp_t gfp)
 {
@@ -402,13 +432,33 @@ static inline int flq_refill_pages(struct qdma_descq *descq,
 				flq->recycle_idx == flq->alloc_idx)
 				break;
 
-			flq_unmap_page_one(pg_sdesc, dev, flq->desc_pg_order);
-			put_page(pg_sdesc->pg_base);
+			/** pg_base is NULL if an earlier refill of this
+			 *  page failed, only the allocation is left to do
+			 */
+			if (pg_sdesc->pg_base) {
+				/** flip back to the start of the page and keep
+				 *  its dma mapping if nobody else holds a
+				 *  reference
+				 */
+				if (flq_page_reusable(pg_sdesc->pg_base,
+						      node)) {
+					flq->pg_reuse++;
+					flq->recycle_idx++;
+					continue;
+				}
+
+				flq_unmap_page_one(pg_sdesc, dev,
+						   flq->desc_pg_order);
+				put_page(pg_sdesc->pg_base);
+				pg_sdesc->pg_base = NULL;
+			}
+
 			rv = flq_fill_page_one(pg_sdesc,
 					dev, node, flq->desc_pg_order, gfp);
 			if (rv < 0)
 				break;
 
+			flq->pg_alloc++;
 			flq->recycle_idx++;
 		}
 	}
@@ -432,6 +482,17 @@ static int qdma_flq_refill(struct qdma_descq *descq, int idx, int count,
 			pr_err("%s: flq_refill_pages failed rv %d error",
 					descq->conf.name, rv);
 		}
+
+		/* descriptors left empty by an earlier failed refill
+		 * come first, the ring is only posted contiguously
+		 */
+		if (flq->refill_pend) {
+			idx = ring_idx_decr(idx, flq->refill_pend, flq->size);
+			count += flq->refill_pend;
+			sdesc = flq->sdesc + idx;
+			desc = flq->desc + idx;
+			sinfo = flq->sdesc_info + idx;
+		}
 	}
 
 	for (i = 0; i < count; i++, idx++, sdesc++, desc++, sinfo++) {
@@ -448,7 +509,7 @@ static int qdma_flq_refill(struct qdma_descq *descq, int idx, int count,
 			flq_free_one(sdesc, desc);
 			rv = flq_fill_one(descq, sdesc, desc);
 			if (unlikely(rv < 0)) {
-				pr_err("%s: rv %d error",
+				pr_debug("%s: rv %d error",
 						descq->conf.name, rv);
 				if (rv == -ENOMEM)
 					flq->alloc_fail++;
@@ -462,8 +523,10 @@ static int qdma_flq_refill(struct qdma_descq *descq, int idx, int count,
 		descq->avail++;
 	}
 
-	if (list_empty(&descq->work_list) &&
-			list_empty(&descq->pend_list)) {
+	if (!recycle)
+		flq->refill_pend = count - i;
+
+	if (list_empty(&descq->pend_list)) {
 		descq->pend_list_empty = 1;
 		if (descq->q_stop_wait)
 			qdma_waitq_wakeup(&descq->pend_list_wq);
@@ -693,6 +756,63 @@ int parse_cmpl_entry(struct qdma_descq *descq, struct qdma_ul_cmpt_info *cmpl)
 	return 0;
 }
 
+/*
+ * 8B completion entries are parsed in batches: the colour, format, error and
+ * desc_used bits of all entries up to the first stale one are folded into
+ * two words, and only (len, desc_used) is kept per entry. Anything unusual
+ * in a batch is left to the per-entry path, which reports the error.
+ */
+#define QDMA_CMPT_BATCH_MAX		8
+#define QDMA_CMPT_BATCH_SCALAR		1
+
+struct qdma_cmpt_tuple {
+	u16 len;
+	u8 desc_used;
+};
+
+static int parse_cmpl_batch_8b(struct qdma_descq *descq,
+				struct qdma_cmpt_tuple *tup, unsigned int max)
+{
+	__be64 *cmpt = (__be64 *)descq->desc_cmpt_cur;
+	u64 color = descq->color ? F_C2H_CMPT_ENTRY_F_COLOR : 0;
+	u64 or_bits = 0;
+	u64 and_bits = ~0ULL;
+	unsigned int n = descq->conf.rngsz_cmpt - descq->cidx_cmpt;
+	unsigned int i;
+
+	/* do not cross the ring end, cmpt_next() flips the colour there */
+	if (n > max)
+		n = max;
+	if (n > QDMA_CMPT_BATCH_MAX)
+		n = QDMA_CMPT_BATCH_MAX;
+
+	dma_rmb();
+
+	for (i = 0; i < n; i++) {
+		u64 w = cmpt[i];
+
+		if ((w & F_C2H_CMPT_ENTRY_F_COLOR) != color)
+			break;
+		or_bits |= w;
+		and_bits &= w;
+		tup[i].len = (w >> S_C2H_CMPT_ENTRY_LENGTH) &
+				M_C2H_CMPT_ENTRY_LENGTH;
+		tup[i].desc_used = (w & F_C2H_CMPT_ENTRY_F_DESC_USED) ? 1 : 0;
+	}
+
+	if (!i)
+		return 0;
+
+	if (unlikely(or_bits & (F_C2H_CMPT_ENTRY_F_FORMAT |
+				F_C2H_CMPT_ENTRY_F_ERR)))
+		return -EINVAL;
+	if (unlikely(!(and_bits & F_C2H_CMPT_ENTRY_F_DESC_USED) &&
+		     !descq->conf.cmpl_udd_en))
+		return -EINVAL;
+
+	return i;
+}
+
 static int get_fl_nr(unsigned int len,
 		unsigned int c2h_bufsz,
 		unsigned int pg_shift, unsigned int pg_mask,
@@ -1007,18 +1127,100 @@ err_out:
 
 }
 
-int descq_process_completion_st_c2h(struct qdma_descq *descq, int budget,
-					bool upd_cmpl)
+/*
+ * returns 0 when done or when a packet could not be delivered,
+ * QDMA_CMPT_BATCH_SCALAR when the remaining entries need the per-entry path
+ */
+static int descq_rcv_cmpl_batch_8b(struct qdma_descq *descq, int budget,
+				   unsigned int *pidx, int *proc_cnt)
+{
+	struct qdma_cmpt_tuple tup[QDMA_CMPT_BATCH_MAX];
+	struct qdma_ul_cmpt_info cmpl;
+
+	while (*proc_cnt < budget) {
+		__be64 *entry = (__be64 *)descq->desc_cmpt_cur;
+		int n = parse_cmpl_batch_8b(descq, tup, budget - *proc_cnt);
+		int i;
+
+		if (n <= 0)
+			return n ? QDMA_CMPT_BATCH_SCALAR : 0;
+
+		for (i = 0; i < n; i++) {
+			int rv;
+
+			/* rcv_pkt/rcv_udd_only only look at pidx and entry */
+			cmpl.pidx = *pidx;
+			cmpl.entry = entry + i;
+			if (tup[i].desc_used)
+				rv = rcv_pkt(descq, &cmpl, tup[i].len);
+			else
+				rv = rcv_udd_only(descq, &cmpl);
+			if (rv < 0) /* cannot process now, stop */
+				return 0;
+
+			*pidx = cmpl.pidx;
+			cmpt_next(descq);
+			(*proc_cnt)++;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * With the completion status writeback disabled, the producer index is found
+ * by walking the ring from cidx_cmpt while the colour bit matches. At most
+ * max entries are checked.
+ */
+static unsigned int descq_cmpt_pidx_by_color(struct qdma_descq *descq,
+					     unsigned int max)
+{
+	unsigned int rngsz_cmpt = descq->conf.rngsz_cmpt;
+	unsigned int cidx = descq->cidx_cmpt;
+	u8 *cmpt = (u8 *)descq->desc_cmpt_cur;
+	u64 color = descq->color ? F_C2H_CMPT_ENTRY_F_COLOR : 0;
+	unsigned int i;
+
+	if (!max || max >= rngsz_cmpt)
+		max = rngsz_cmpt - 1;
+
+	for (i = 0; i < max; i++) {
+		__be64 *entry = (__be64 *)cmpt;
+
+		if ((entry[0] & F_C2H_CMPT_ENTRY_F_COLOR) != color)
+			break;
+		if (++cidx == rngsz_cmpt) {
+			cidx = 0;
+			color ^= F_C2H_CMPT_ENTRY_F_COLOR;
+			cmpt = (u8 *)descq->desc_cmpt;
+		} else
+			cmpt += descq->cmpt_entry_len;
+	}
+
+	return cidx;
+}
+
+static inline unsigned int descq_cmpt_pidx(struct qdma_descq *descq,
+					   unsigned int max)
 {
-	struct xlnx_dma_dev *xdev = descq->xdev;
 	struct qdma_c2h_cmpt_cmpl_status *cs =
 			(struct qdma_c2h_cmpt_cmpl_status *)
 			descq->desc_cmpt_cmpl_status;
+
+	if (descq->conf.cmpl_stat_en)
+		return cs->pidx;
+	return descq_cmpt_pidx_by_color(descq, max);
+}
+
+int descq_process_completion_st_c2h(struct qdma_descq *descq, int budget,
+					bool upd_cmpl)
+{
+	struct xlnx_dma_dev *xdev = descq->xdev;
 	struct qdma_queue_conf *qconf = &descq->conf;
 	unsigned int rngsz_cmpt = qconf->rngsz_cmpt;
 	unsigned int pidx = descq->pidx;
 	unsigned int cidx_cmpt = descq->cidx_cmpt;
-	unsigned int pidx_cmpt = cs->pidx;
+	unsigned int pidx_cmpt;
 	struct qdma_flq *flq = (struct qdma_flq *)descq->flq;
 	unsigned int pidx_pend = flq->pidx_pend;
 	bool uld_handler = descq->conf.fp_descq_c2h_packet ? true : false;
@@ -1028,6 +1230,8 @@ int descq_process_completion_st_c2h(struct qdma_descq *descq, int budget,
 	int proc_cnt = 0;
 	int rv = 0;
 	int read_weight = budget;
+	/* one entry past the budget tells whether more are pending */
+	unsigned int scan_max = budget ? budget + 1 : 0;
 
 	/* once an error happens, stop processing of the Q */
 	if (descq->err) {
@@ -1036,12 +1240,16 @@ int descq_process_completion_st_c2h(struct qdma_descq *descq, int budget,
 	}
 
 	dma_rmb();
+	pidx_cmpt = descq_cmpt_pidx(descq, scan_max);
 	pend = ring_idx_delta(pidx_cmpt, cidx_cmpt, rngsz_cmpt);
 	if (!pend) {
+		flq->pkt_cnt = 0;
 		/* SW work around where next interrupt could be missed when
-		 * there are no entries as of now
+		 * there are no entries as of now. With a ULD handler the cidx
+		 * is written by the caller, which decides on the re-arm.
 		 */
-		if (descq->xdev->conf.qdma_drv_mode != POLL_MODE) {
+		if (descq->xdev->conf.qdma_drv_mode != POLL_MODE &&
+		    !uld_handler) {
 			rv = queue_cmpt_cidx_update(descq->xdev,
 					descq->conf.qidx,
 					&descq->cmpt_cidx_info);
@@ -1055,12 +1263,18 @@ int descq_process_completion_st_c2h(struct qdma_descq *descq, int budget,
 	}
 
 #if 0
-	print_hex_dump(KERN_INFO, "cmpl status: ", DUMP_PREFIX_OFFSET,
-				16, 1, (void *)cs, sizeof(*cs),
-				false);
-	pr_info("cmpl status: pidx 0x%x, cidx %x, color %d, int_state 0x%x.\n",
-		cs->pidx, cs->cidx, cs->color_isr_status & 0x1,
-		(cs->color_isr_status >> 1) & 0x3);
+	{
+		struct qdma_c2h_cmpt_cmpl_status *cs =
+				(struct qdma_c2h_cmpt_cmpl_status *)
+				descq->desc_cmpt_cmpl_status;
+
+		print_hex_dump(KERN_INFO, "cmpl status: ", DUMP_PREFIX_OFFSET,
+					16, 1, (void *)cs, sizeof(*cs),
+					false);
+		pr_info("cmpl status: pidx 0x%x, cidx %x, color %d, int_state 0x%x.\n",
+			cs->pidx, cs->cidx, cs->color_isr_status & 0x1,
+			(cs->color_isr_status >> 1) & 0x3);
+	}
 #endif
 
 	flq->pkt_cnt = pend;
@@ -1068,6 +1282,11 @@ int descq_process_completion_st_c2h(struct qdma_descq *descq, int budget,
 	if (!budget || budget > pend)
 		budget = pend;
 
+	if (!is_ul_ext && descq->cmpt_entry_len == 8 &&
+	    descq_rcv_cmpl_batch_8b(descq, budget, &pidx, &proc_cnt) !=
+						QDMA_CMPT_BATCH_SCALAR)
+		goto cmpl_done;
+
 	while (likely(proc_cnt < budget)) {
 		struct qdma_ul_cmpt_info cmpl;
 		int rv;
@@ -1106,12 +1325,14 @@ int descq_process_completion_st_c2h(struct qdma_descq *descq, int budget,
 		proc_cnt++;
 	}
 
+cmpl_done:
 	flq->pkt_cnt -= proc_cnt;
 
 	if ((xdev->conf.intr_moderation) &&
 			(descq->cmpt_cidx_info.trig_mode ==
 					TRIG_MODE_COMBO)) {
-		pend = ring_idx_delta(cs->pidx, descq->cidx_cmpt, rngsz_cmpt);
+		pend = ring_idx_delta(descq_cmpt_pidx(descq, scan_max),
+				      descq->cidx_cmpt, rngsz_cmpt);
 		flq->pkt_cnt = pend;
 
 		/* we dont need interrupt if packets available for next read */
@@ -1130,7 +1351,6 @@ int descq_process_completion_st_c2h(struct qdma_descq *descq, int budget,
 	}
 
 	if (proc_cnt) {
-		descq->pidx_cmpt = pidx_cmpt;
 		descq->pidx = pidx;
 		descq->cmpt_cidx_info.wrb_cidx = descq->cidx_cmpt;
 		if (!descq->conf.fp_descq_c2h_packet) {
@@ -1144,8 +1364,8 @@ int descq_process_completion_st_c2h(struct qdma_descq *descq, int budget,
 			qdma_c2h_packets_proc_dflt(descq);
 		}
 
-		flq->pkt_cnt = ring_idx_delta(cs->pidx, descq->cidx_cmpt,
-					      rngsz_cmpt);
+		flq->pkt_cnt = ring_idx_delta(descq_cmpt_pidx(descq, scan_max),
+					      descq->cidx_cmpt, rngsz_cmpt);
 
 		/* some descq entries have been consumed */
 		if (flq->pidx_pend != pidx_pend) {
@@ -1154,8 +1374,24 @@ int descq_process_completion_st_c2h(struct qdma_descq *descq, int budget,
 			qdma_flq_refill(descq, pidx_pend, pend,
 					uld_handler ? 0 : 1, GFP_ATOMIC);
 
+			/* GFP_ATOMIC could not keep up, refill the rest in
+			 * process context
+			 */
+			if (flq->refill_pend &&
+			    (descq->avail <
+			     (flq->size >> QDMA_FLQ_LOW_WM_SHIFT)) &&
+			    qdma_wq_queue_work(&descq->xdev->dp_wq,
+					       WORK_CPU_UNBOUND,
+					       &descq->flq_refill_work,
+					       &descq->flq_refill_qtime)) {
+				flq->starved++;
+				trace_qdma_flq_starved(descq,
+						       flq->refill_pend);
+			}
+
 			if (upd_cmpl && !descq->q_stop_wait) {
-				pend = ring_idx_decr(flq->pidx_pend, 1,
+				pend = ring_idx_decr(flq->pidx_pend,
+						     1 + flq->refill_pend,
 						     flq->size);
 				descq->pidx_info.pidx = pend;
 				if (!descq->conf.fp_descq_c2h_packet) {
@@ -1176,6 +1412,119 @@ int descq_process_completion_st_c2h(struct qdma_descq *descq, int budget,
 	return 0;
 }
 
+void descq_flq_refill_work(struct work_struct *work)
+{
+	struct qdma_descq *descq = container_of(work, struct qdma_descq,
+						flq_refill_work);
+	struct qdma_flq *flq = (struct qdma_flq *)descq->flq;
+	struct device *dev = &descq->xdev->conf.pdev->dev;
+	int node = dev_to_node(dev);
+	struct qdma_sw_pg_sg spare = { 0 };
+	struct qdma_sw_pg_sg *pg_sdesc;
+	unsigned char pg_order;
+	unsigned int refill_pend;
+	int rv;
+
+	qdma_wq_work_start(&descq->xdev->dp_wq, descq->flq_refill_qtime);
+
+	lock_descq(descq);
+	pg_order = flq->desc_pg_order;
+	unlock_descq(descq);
+
+	while (1) {
+		/* sleeping allocation, outside of the descq lock */
+		if (!spare.pg_base) {
+			rv = flq_fill_page_one(&spare, dev, node, pg_order,
+					       GFP_KERNEL);
+			if (rv < 0)
+				break;
+		}
+
+		lock_descq(descq);
+		if ((descq->q_state != Q_STATE_ONLINE) || !flq->refill_pend) {
+			unlock_descq(descq);
+			break;
+		}
+
+		/* hand the spare page to the slot the atomic path left empty */
+		pg_sdesc = flq->pg_sdesc +
+			(flq->recycle_idx & flq->num_pgs_mask);
+		if (!pg_sdesc->pg_base && !pg_sdesc->pg_offset &&
+		    (flq->recycle_idx != flq->alloc_idx)) {
+			*pg_sdesc = spare;
+			memset(&spare, 0, sizeof(struct qdma_sw_pg_sg));
+			flq->pg_alloc++;
+			flq->recycle_idx++;
+		}
+
+		refill_pend = flq->refill_pend;
+		qdma_flq_refill(descq, flq->pidx_pend, 0, 0, GFP_ATOMIC);
+
+		/* single doorbell for everything refilled */
+		if (flq->refill_pend != refill_pend) {
+			descq->pidx_info.pidx = ring_idx_decr(flq->pidx_pend,
+						1 + flq->refill_pend,
+						flq->size);
+			rv = queue_pidx_update(descq->xdev, descq->conf.qidx,
+					descq->conf.q_type, &descq->pidx_info);
+			if (unlikely(rv < 0))
+				pr_err("%s: Failed to update pidx\n",
+						descq->conf.name);
+		}
+
+		/* no progress, leave it to the next completion */
+		if (flq->refill_pend == refill_pend && spare.pg_base) {
+			unlock_descq(descq);
+			break;
+		}
+		unlock_descq(descq);
+	}
+
+	if (spare.pg_base) {
+		flq_unmap_page_one(&spare, dev, pg_order);
+		put_page(spare.pg_base);
+	}
+}
+
+int qdma_descq_dump_flq(struct qdma_descq *descq, char *buf, int buflen)
+{
+	struct qdma_flq *flq = (struct qdma_flq *)descq->flq;
+	unsigned long pg_total = flq->pg_reuse + flq->pg_alloc;
+	unsigned long mem;
+	char *cur = buf;
+	char *const end = buf + buflen;
+
+	/* pages + page list + sw sg list and info */
+	mem = ((unsigned long)flq->num_pages << (PAGE_SHIFT +
+				flq->desc_pg_order)) +
+		(flq->num_pages * sizeof(struct qdma_sw_pg_sg)) +
+		(flq->size * (sizeof(struct qdma_sw_sg) +
+			      sizeof(struct qdma_sdesc_info)));
+
+	cur += snprintf(cur, end - cur,
+		"\tflq buf %u/%u, %u pages of order %u, mem %lu KB\n",
+		descq->conf.c2h_bufsz, flq->desc_buf_size, flq->num_pages,
+		flq->desc_pg_order, mem >> 10);
+	if (cur >= end)
+		return buflen;
+
+	cur += snprintf(cur, end - cur,
+		"\tflq pg reuse %lu/%lu (%lu%%), alloc_fail %lu, mapping_err %lu\n",
+		flq->pg_reuse, pg_total,
+		pg_total ? (flq->pg_reuse * 100) / pg_total : 0,
+		flq->alloc_fail, flq->mapping_err);
+	if (cur >= end)
+		return buflen;
+
+	cur += snprintf(cur, end - cur,
+		"\tflq refill pend %u, starved %lu\n",
+		flq->refill_pend, flq->starved);
+	if (cur >= end)
+		return buflen;
+
+	return cur - buf;
+}
+
 int qdma_queue_c2h_peek(unsigned long dev_hndl, unsigned long id,
 			unsigned int *udd_cnt, unsigned int *pkt_cnt,
 			unsigned int *data_len)
@@ -1209,6 +1558,113 @@ int qdma_queue_c2h_peek(unsigned long dev_hndl, unsigned long id,
 	return 0;
 }
 
+int qdma_queue_c2h_service(unsigned long dev_hndl, unsigned long qhndl,
+			   int budget, struct qdma_c2h_service_stat *stat)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_descq *descq;
+
+	if (!xdev) {
+		pr_err("dev_hndl is NULL");
+		return -EINVAL;
+	}
+
+	descq = qdma_device_get_descq_by_id(xdev, qhndl, NULL, 0, 0);
+	if (unlikely(!descq || !descq->conf.st ||
+		     descq->conf.q_type != Q_C2H)) {
+		pr_err("Invalid qid(%ld)", qhndl);
+		return -EINVAL;
+	}
+
+	return qdma_queue_c2h_service_fp(descq, budget, stat);
+}
+
+int qdma_queue_c2h_service_fp(struct qdma_descq *descq, int budget,
+			      struct qdma_c2h_service_stat *stat)
+{
+	struct qdma_flq *flq;
+	unsigned int cidx_cmpt;
+	unsigned int processed = 0, pending = 0;
+	int rv;
+
+	if (unlikely(descq_fp_check(descq) < 0))
+		return -EINVAL;
+#ifdef DEBUG
+	if (unlikely(!descq->conf.st || descq->conf.q_type != Q_C2H)) {
+		pr_err("%s: st %d, type %d.\n",
+			descq->conf.name, descq->conf.st, descq->conf.q_type);
+		return -EINVAL;
+	}
+#endif
+	flq = (struct qdma_flq *)descq->flq;
+
+	lock_descq(descq);
+	cidx_cmpt = descq->cidx_cmpt;
+	if (descq->q_state == Q_STATE_ONLINE) {
+		rv = descq_process_completion_st_c2h(descq, budget, true);
+		if (rv == -ENODATA)
+			rv = 0;
+		else if (rv)
+			pr_err("Error detected in %s", descq->conf.name);
+	} else {
+		pr_debug("Invalid q state of %s ", descq->conf.name);
+		rv = -ENODEV;
+	}
+
+	processed = ring_idx_delta(descq->cidx_cmpt, cidx_cmpt,
+				   descq->conf.rngsz_cmpt);
+	if (!rv)
+		pending = flq->pkt_cnt;
+
+	/* the completion interrupt stays masked, the caller re-arms it once
+	 * it gives up the queue, outside of the queue lock
+	 */
+	if (!rv)
+		rv = descq_c2h_update_pointers(descq, false);
+	unlock_descq(descq);
+
+	if (stat) {
+		stat->processed = processed;
+		stat->pending = pending;
+		/* more than a budget pending keeps the irq off under
+		 * intr_moderation, see descq_process_completion_st_c2h()
+		 */
+		stat->irq_arm = !rv && (!budget || (processed < budget &&
+						     pending <= budget));
+	}
+
+	return rv;
+}
+
+int qdma_queue_c2h_irq_arm_fp(struct qdma_descq *descq)
+{
+	int rv = 0;
+
+	if (unlikely(descq_fp_check(descq) < 0))
+		return -EINVAL;
+
+	/* polled queues and deferred interrupts have nothing to re-arm */
+	if (!descq->cmpt_cidx_info.irq_en)
+		return 0;
+
+	lock_descq(descq);
+	if (descq->q_state == Q_STATE_ONLINE) {
+		rv = queue_cmpt_cidx_update(descq->xdev, descq->conf.qidx,
+					    &descq->cmpt_cidx_info);
+		if (unlikely(rv < 0)) {
+			pr_err("%s: Failed to update cmpt cidx\n",
+			       descq->conf.name);
+			rv = -EBUSY;
+		}
+	} else {
+		pr_debug("Invalid q state of %s ", descq->conf.name);
+		rv = -ENODEV;
+	}
+	unlock_descq(descq);
+
+	return rv;
+}
+
 int qdma_queue_packet_read(unsigned long dev_hndl, unsigned long id,
 			struct qdma_request *req, struct qdma_cmpl_ctrl *cctrl)
 {
@@ -1247,6 +1703,8 @@ int qdma_queue_packet_read(unsigned long dev_hndl, unsigned long id,
 	}
 
 	if (cctrl) {
+		qdma_descq_csr_slots_move(descq, cctrl->timer_idx,
+					  cctrl->cnt_th_idx);
 		lock_descq(descq);
 
 		descq->cmpt_cidx_info.trig_mode =
@@ -83,57 +83,63 @@ struct qdma_sw_pg_sg {
  * @brief qdma free list q page allocation book keeping
  */
 struct qdma_flq {
+	/* completion path, touched for every packet */
+	/** RW: sw scatter gather list */
+	struct qdma_sw_sg *sdesc;
+	/** RW: sw descriptor info */
+	struct qdma_sdesc_info *sdesc_info;
 	/** RO: size of the decriptor */
 	unsigned int size;
+	/** RW: pending pidxes */
+	unsigned int pidx_pend;
+	/** RW: # of consumed descriptors not refilled yet */
+	unsigned int refill_pend;
+	/** RW: total # of udd outstanding */
+	unsigned int udd_cnt;
+	/** RW: total # of packet outstanding */
+	unsigned int pkt_cnt;
+	/** RW: total # of pkt payload length outstanding */
+	unsigned int pkt_dlen;
 	/** RO: c2h buffer size */
 	unsigned int desc_buf_size;
+	/** RO: number of buffers per page */
+	unsigned int num_bufs_per_pg;
+	/** RO: pointer to qdma c2h decriptor */
+	struct qdma_c2h_desc *desc;
+	/** RW: Page list */
+	struct qdma_sw_pg_sg *pg_sdesc;
+
+	/* refill path */
 	/** RO: number of pages */
 	unsigned int num_pages;
 	/** RO: Mask for number of pages */
 	unsigned int num_pgs_mask;
-	/** RO: number of buffers per page */
-	unsigned int num_bufs_per_pg;
 	/** RO: number of currently allocated page index */
 	unsigned int alloc_idx;
 	/** RO: number of currently recycled page index */
 	unsigned int recycle_idx;
 	/** RO: max page offset */
 	unsigned int max_pg_offset;
-	/** RO: page order */
-	unsigned int buf_pg_mask;
 	/** RO: desc page order */
 	unsigned char desc_pg_order;
 	/** RO: desc page shift */
 	unsigned char desc_pg_shift;
+
+	/* setup and statistics */
 	/** RO: page shift */
 	unsigned char buf_pg_shift;
-	/** RO: pointer to qdma c2h decriptor */
-	struct qdma_c2h_desc *desc;
-
-	/** RW: total # of udd outstanding */
-	unsigned int udd_cnt;
-	/** RW: total # of packet outstanding */
-	unsigned int pkt_cnt;
-	/** RW: total # of pkt payload length outstanding */
-	unsigned int pkt_dlen;
-	/** RW: # of available Rx buffers */
-	unsigned int avail;
+	/** RO: page order */
+	unsigned int buf_pg_mask;
 	/** RW: # of times buffer allocation failed */
 	unsigned long alloc_fail;
 	/** RW: # of RX Buffer DMA Mapping failures */
 	unsigned long mapping_err;
-	/** RW: consumer index */
-	unsigned int cidx;
-	/** RW: producer index */
-	unsigned int pidx;
-	/** RW: pending pidxes */
-	unsigned int pidx_pend;
-	/** RW: Page list */
-	struct qdma_sw_pg_sg *pg_sdesc;
-	/** RW: sw scatter gather list */
-	struct qdma_sw_sg *sdesc;
-	/** RW: sw descriptor info */
-	struct qdma_sdesc_info *sdesc_info;
+	/** RW: # of pages reused with their dma mapping on refill */
+	unsigned long pg_reuse;
+	/** RW: # of pages newly allocated and mapped on refill */
+	unsigned long pg_alloc;
+	/** RW: # of times the queue dropped below the refill low-water mark */
+	unsigned long starved;
 };
 
 /*****************************************************************************/
@@ -224,4 +230,27 @@ int descq_process_completion_st_c2h(struct qdma_descq *descq, int budget,
 int descq_st_c2h_read(struct qdma_descq *descq, struct qdma_request *req,
 			bool update_pidx, bool refill);
 
+/*****************************************************************************/
+/**
+ * descq_flq_refill_work() - refill the freelist in process context when
+ *				GFP_ATOMIC allocations have failed
+ *
+ * @param[in]	work:		pointer to the descq flq_refill_work
+ *
+ * @return	none
+ *****************************************************************************/
+void descq_flq_refill_work(struct work_struct *work);
+
+/*****************************************************************************/
+/**
+ * qdma_descq_dump_flq() - dump the freelist memory and page statistics
+ *
+ * @param[in]	descq:		pointer to qdma_descq
+ * @param[in]	buflen:		length of the input buffer
+ * @param[out]	buf:		message buffer
+ *
+ * @return	length of the string copied into buffer
+ *****************************************************************************/
+int qdma_descq_dump_flq(struct qdma_descq *descq, char *buf, int buflen);
+
 #endif /* ifndef __QDMA_ST_C2H_H__ */
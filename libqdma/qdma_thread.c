@@ -22,8 +22,16 @@
 #include "qdma_thread.h"
 
 #include <linux/kernel.h>
+#include <linux/mutex.h>
+#include <linux/cpumask.h>
+#include <linux/topology.h>
+#include <linux/version.h>
+#if KERNEL_VERSION(4, 15, 0) <= LINUX_VERSION_CODE
+#include <linux/sched/isolation.h>
+#endif
 
 #include "qdma_descq.h"
+#include "qdma_device.h"
 #include "thread.h"
 #include "xdev.h"
 
@@ -32,6 +40,11 @@
 static unsigned int thread_cnt;
 /** completion status threads */
 static struct qdma_kthread *cs_threads;
+/** number of threads requested at init, 0 for one per online cpu */
+static unsigned int thread_req;
+/** poll mode devices using the completion status threads */
+static unsigned int thread_users;
+static DEFINE_MUTEX(thread_mutex);
 
 static spinlock_t	qcnt_lock;
 static unsigned int cpu_count;
@@ -47,13 +60,13 @@ static int qdma_thread_cmpl_status_pend(struct list_head *work_item)
 {
 	struct qdma_descq *descq = list_entry(work_item, struct qdma_descq,
 						cmplthp_list);
-	int pend = 0;
 
-	lock_descq(descq);
-	pend = !list_empty(&descq->pend_list) || !list_empty(&descq->work_list);
-	unlock_descq(descq);
+	/* lockless hint only, fproc rechecks under the descq lock */
+	if (descq->conf.st && (descq->conf.q_type == Q_C2H))
+		return !list_empty(&descq->pend_list);
 
-	return pend;
+	return qdma_work_queue_len(descq) ||
+		(READ_ONCE(descq->pidx) != READ_ONCE(descq->cidx));
 }
 
 static int qdma_thread_cmpl_status_proc(struct list_head *work_item)
@@ -65,6 +78,103 @@ static int qdma_thread_cmpl_status_proc(struct list_head *work_item)
 	return 0;
 }
 
+/*
+ * cpus the scheduler is allowed to balance onto, i.e. excluding the ones
+ * carved out with isolcpus=
+ */
+static const struct cpumask *qdma_thread_hk_mask(void)
+{
+#if KERNEL_VERSION(5, 18, 0) <= LINUX_VERSION_CODE
+	return housekeeping_cpumask(HK_TYPE_DOMAIN);
+#elif KERNEL_VERSION(4, 15, 0) <= LINUX_VERSION_CODE
+	return housekeeping_cpumask(HK_FLAG_DOMAIN);
+#else
+	return cpu_possible_mask;
+#endif
+}
+
+/* cpus sharing the last level cache with @cpu */
+static const struct cpumask *qdma_thread_llc_mask(int cpu)
+{
+#ifdef CONFIG_X86
+	return cpu_llc_shared_mask(cpu);
+#else
+	return topology_core_cpumask(cpu);
+#endif
+}
+
+static bool qdma_thread_cpu_usable(int cpu, int node)
+{
+	if (!cpu_online(cpu) || !cpumask_test_cpu(cpu, qdma_thread_hk_mask()))
+		return false;
+	return node == NUMA_NO_NODE || cpu_to_node(cpu) == node;
+}
+
+/*
+ * pick the least loaded cpu, comparing first the average queue count of its
+ * llc domain, so that consecutive queues land on different caches, then its
+ * own queue count. qcnt_lock must be held.
+ */
+static int qdma_thread_pick_cpu(int node)
+{
+	unsigned int best_sum = 0, best_weight = 1, best_cnt = 0;
+	int best = -1;
+	int cpu, sib;
+
+	for_each_online_cpu(cpu) {
+		unsigned int sum = 0, weight = 0;
+
+		if (!qdma_thread_cpu_usable(cpu, node))
+			continue;
+
+		for_each_cpu(sib, qdma_thread_llc_mask(cpu)) {
+			if (!qdma_thread_cpu_usable(sib, node))
+				continue;
+			sum += per_cpu_qcnt[sib];
+			weight++;
+		}
+		if (!weight)
+			weight = 1;
+
+		/* sum / weight < best_sum / best_weight, without dividing */
+		if (best < 0 || sum * best_weight < best_sum * weight ||
+		    (sum * best_weight == best_sum * weight &&
+		     per_cpu_qcnt[cpu] < best_cnt)) {
+			best = cpu;
+			best_sum = sum;
+			best_weight = weight;
+			best_cnt = per_cpu_qcnt[cpu];
+		}
+	}
+
+	return best;
+}
+
+/*
+ * the h2c and c2h queue of a pair share an interrupt vector and the same
+ * napi/uld context, keep their completion work on one cpu
+ */
+static int qdma_thread_partner_cpu(struct qdma_descq *descq)
+{
+	struct qdma_descq *peer;
+	int cpu = -1;
+
+	if (descq->conf.q_type == Q_CMPT)
+		return -1;
+
+	peer = qdma_device_get_descq_by_hw_qid(descq->xdev, descq->qidx_hw,
+					descq->conf.q_type == Q_C2H ? 0 : 1);
+	if (!peer || peer == descq)
+		return -1;
+
+	lock_descq(peer);
+	if (peer->cpu_assigned && cpu_online(peer->intr_work_cpu))
+		cpu = peer->intr_work_cpu;
+	unlock_descq(peer);
+
+	return cpu;
+}
+
 /* ********************* public function definitions ************************ */
 
 void qdma_thread_remove_work(struct qdma_descq *descq)
@@ -96,12 +206,27 @@ void qdma_thread_remove_work(struct qdma_descq *descq)
 
 	if (cmpl_thread) {
 		lock_thread(cmpl_thread);
-		list_del(&descq->cmplthp_list);
-		cmpl_thread->work_cnt--;
+		list_del_rcu(&descq->cmplthp_list);
+		if (!--cmpl_thread->work_cnt)
+			cmpl_thread->spin_us = 0;
 		unlock_thread(cmpl_thread);
+		/* the thread may still be walking over the entry */
+		synchronize_rcu();
 	}
 }
 
+unsigned int qdma_thread_cpu_qcnt(unsigned int cpu)
+{
+	unsigned int cnt = 0;
+
+	spin_lock(&qcnt_lock);
+	if (per_cpu_qcnt && cpu < cpu_count)
+		cnt = per_cpu_qcnt[cpu];
+	spin_unlock(&qcnt_lock);
+
+	return cnt;
+}
+
 void qdma_thread_add_work(struct qdma_descq *descq)
 {
 	struct qdma_kthread *thp = cs_threads;
@@ -109,16 +234,17 @@ void qdma_thread_add_work(struct qdma_descq *descq)
 	int i, idx = thread_cnt;
 
 	if (descq->xdev->conf.qdma_drv_mode != POLL_MODE) {
-		spin_lock(&qcnt_lock);
-		idx = cpu_count - 1;
-		v = per_cpu_qcnt[idx];
-		for (i = idx - 1; i >= 0  && v; i--) {
-			if (per_cpu_qcnt[i] < v) {
-				idx = i;
-				v = per_cpu_qcnt[i];
-			}
-		}
+		int node = dev_to_node(&descq->xdev->conf.pdev->dev);
+
+		idx = qdma_thread_partner_cpu(descq);
 
+		spin_lock(&qcnt_lock);
+		if (idx < 0 && node != NUMA_NO_NODE)
+			idx = qdma_thread_pick_cpu(node);
+		if (idx < 0)
+			idx = qdma_thread_pick_cpu(NUMA_NO_NODE);
+		if (idx < 0)
+			idx = cpumask_first(cpu_online_mask);
 		per_cpu_qcnt[idx]++;
 		spin_unlock(&qcnt_lock);
 
@@ -134,6 +260,12 @@ void qdma_thread_add_work(struct qdma_descq *descq)
 	}
 
 	/* Polled mode only */
+	if (!thread_cnt) {
+		pr_warn("%s no cmpl status thread running.\n",
+			descq->conf.name);
+		return;
+	}
+
 	for (i = 0; i < thread_cnt; i++, thp++) {
 		lock_thread(thp);
 		if (idx == thread_cnt) {
@@ -150,9 +282,10 @@ void qdma_thread_add_work(struct qdma_descq *descq)
 
 	thp = cs_threads + idx;
 	lock_thread(thp);
-	list_add_tail(&descq->cmplthp_list, &thp->work_list);
+	list_add_tail_rcu(&descq->cmplthp_list, &thp->work_list);
 	descq->intr_work_cpu = idx;
 	thp->work_cnt++;
+	thp->spin_us = max(thp->spin_us, descq->xdev->conf.poll_spin_us);
 	unlock_thread(thp);
 
 	pr_debug("%s 0x%p assigned to cmpl status thread %s,%u.\n",
@@ -163,57 +296,107 @@ void qdma_thread_add_work(struct qdma_descq *descq)
 	unlock_descq(descq);
 }
 
-int qdma_threads_create(unsigned int num_threads)
+static void qdma_threads_stop(void)
 {
-	struct qdma_kthread *thp;
 	int i;
-	int rv;
+	struct qdma_kthread *thp;
 
-	if (thread_cnt) {
-		pr_warn("threads already created!");
-		return 0;
-	}
-	spin_lock_init(&qcnt_lock);
+	if (!thread_cnt)
+		return;
 
-	cpu_count = num_online_cpus();
-	per_cpu_qcnt = kzalloc(cpu_count * sizeof(unsigned int), GFP_KERNEL);
-	if (!per_cpu_qcnt)
-		return -ENOMEM;
+	/* N dma writeback monitoring threads */
+	thp = cs_threads;
+	for (i = 0; i < thread_cnt; i++, thp++)
+		if (thp->task)
+			qdma_kthread_stop(thp);
 
-	thread_cnt = (num_threads == 0) ? cpu_count : num_threads;
+	kfree(cs_threads);
+	cs_threads = NULL;
+	thread_cnt = 0;
+}
 
-	cs_threads = kzalloc(thread_cnt * sizeof(struct qdma_kthread),
-					GFP_KERNEL);
+static int qdma_threads_start(void)
+{
+	struct qdma_kthread *thp;
+	unsigned int cnt;
+	int cpu = -1;
+	int i;
+	int rv;
+
+	cnt = thread_req ? thread_req : num_online_cpus();
+
+	cs_threads = kzalloc(cnt * sizeof(struct qdma_kthread), GFP_KERNEL);
 	if (!cs_threads)
 		return -ENOMEM;
+	thread_cnt = cnt;
 
-	/* N dma writeback monitoring threads */
+	/* N dma writeback monitoring threads, spread over the online cpus */
 	thp = cs_threads;
 	for (i = 0; i < thread_cnt; i++, thp++) {
-		thp->cpu = i;
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+		thp->cpu = cpu;
 		thp->kth_timeout = 0;
+		thp->fproc = qdma_thread_cmpl_status_proc;
+		thp->fpending = qdma_thread_cmpl_status_pend;
 		rv = qdma_kthread_start(thp, "qdma_cmpl_status_th", i);
 		if (rv < 0)
 			goto cleanup_threads;
-		thp->fproc = qdma_thread_cmpl_status_proc;
-		thp->fpending = qdma_thread_cmpl_status_pend;
 	}
 
 	return 0;
 
 cleanup_threads:
-	kfree(cs_threads);
-	cs_threads = NULL;
-	thread_cnt = 0;
+	qdma_threads_stop();
 
 	return rv;
 }
 
-void qdma_threads_destroy(void)
+int qdma_threads_get(void)
 {
-	int i;
-	struct qdma_kthread *thp;
+	int rv = 0;
+
+	mutex_lock(&thread_mutex);
+	if (!thread_users)
+		rv = qdma_threads_start();
+	if (!rv)
+		thread_users++;
+	mutex_unlock(&thread_mutex);
+
+	return rv;
+}
+
+void qdma_threads_put(void)
+{
+	mutex_lock(&thread_mutex);
+	if (thread_users && !--thread_users)
+		qdma_threads_stop();
+	mutex_unlock(&thread_mutex);
+}
+
+int qdma_threads_create(unsigned int num_threads)
+{
+	if (per_cpu_qcnt) {
+		pr_warn("threads already created!");
+		return 0;
+	}
+	spin_lock_init(&qcnt_lock);
+
+	/* indexed by cpu id, which may be sparse with offlined cpus */
+	cpu_count = nr_cpu_ids;
+	per_cpu_qcnt = kzalloc(cpu_count * sizeof(unsigned int), GFP_KERNEL);
+	if (!per_cpu_qcnt)
+		return -ENOMEM;
+
+	/* the threads themselves are started by the first poll mode device */
+	thread_req = num_threads;
+
+	return 0;
+}
 
+void qdma_threads_destroy(void)
+{
 	if (per_cpu_qcnt) {
 		spin_lock(&qcnt_lock);
 		kfree(per_cpu_qcnt);
@@ -221,16 +404,8 @@ void qdma_threads_destroy(void)
 		spin_unlock(&qcnt_lock);
 	}
 
-	if (!thread_cnt)
-		return;
-
-	/* N dma writeback monitoring threads */
-	thp = cs_threads;
-	for (i = 0; i < thread_cnt; i++, thp++)
-		if (thp->fproc)
-			qdma_kthread_stop(thp);
-
-	kfree(cs_threads);
-	cs_threads = NULL;
-	thread_cnt = 0;
+	mutex_lock(&thread_mutex);
+	thread_users = 0;
+	qdma_threads_stop();
+	mutex_unlock(&thread_mutex);
 }
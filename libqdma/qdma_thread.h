@@ -30,12 +30,10 @@ struct qdma_descq;
 
 /*****************************************************************************/
 /**
- * qdma_threads_create() - create qdma threads
- * This functions creates two threads for each cpu in the system or number of
- * number of thread requested by param num_threads and assigns the
- * thread handlers
- * 1: queue processing thread
- * 2: queue completion handler thread
+ * qdma_threads_create() - set up the qdma thread book keeping
+ * The completion status threads, one for each online cpu or the number
+ * requested by param num_threads, are not started until a poll mode device
+ * needs them, see qdma_threads_get()
  *
  * @param[in] num_threads - number of threads to be created
  *
@@ -44,6 +42,25 @@ struct qdma_descq;
  *****************************************************************************/
 int qdma_threads_create(unsigned int num_threads);
 
+/*****************************************************************************/
+/**
+ * qdma_threads_get() - take a reference on the completion status threads,
+ *			starting them for the first poll mode device
+ *
+ * @return	0: success
+ * @return	<0: failure
+ *****************************************************************************/
+int qdma_threads_get(void);
+
+/*****************************************************************************/
+/**
+ * qdma_threads_put() - drop a reference taken with qdma_threads_get(),
+ *			stopping the threads with the last one
+ *
+ * @return	none
+ *****************************************************************************/
+void qdma_threads_put(void);
+
 /*****************************************************************************/
 /**
  * qdma_threads_destroy() - destroy all the qdma threads created
@@ -73,4 +90,15 @@ void qdma_thread_remove_work(struct qdma_descq *descq);
  *****************************************************************************/
 void qdma_thread_add_work(struct qdma_descq *descq);
 
+/*****************************************************************************/
+/**
+ * qdma_thread_cpu_qcnt() - number of queues whose interrupt work is bound
+ *			    to a cpu, across all devices
+ *
+ * @param[in]	cpu:	cpu id
+ *
+ * @return	queue count
+ *****************************************************************************/
+unsigned int qdma_thread_cpu_qcnt(unsigned int cpu);
+
 #endif /* LIBQDMA_QDMA_THREAD_H_ */
@@ -0,0 +1,65 @@
+/*
+ * This file is part of the Xilinx DMA IP Core driver for Linux
+ *
+ * Copyright (c) 2017-2020,  Xilinx, Inc.
+ * All rights reserved.
+ *
+ * This source code is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM qdma
+
+#if !defined(__QDMA_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __QDMA_TRACE_H__
+
+#include <linux/tracepoint.h>
+#include "qdma_descq.h"
+
+/**
+ * qdma_flq_starved - a C2H freelist fell below its low-water mark and the
+ *			refill was deferred to process context
+ */
+TRACE_EVENT(qdma_flq_starved,
+
+	TP_PROTO(struct qdma_descq *descq, unsigned int refill_pend),
+
+	TP_ARGS(descq, refill_pend),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, qidx)
+		__field(unsigned int, qidx_hw)
+		__field(unsigned int, avail)
+		__field(unsigned int, refill_pend)
+	),
+
+	TP_fast_assign(
+		__entry->qidx = descq->conf.qidx;
+		__entry->qidx_hw = descq->qidx_hw;
+		__entry->avail = descq->avail;
+		__entry->refill_pend = refill_pend;
+	),
+
+	TP_printk("qidx %u/%u avail %u refill_pend %u",
+		  __entry->qidx, __entry->qidx_hw, __entry->avail,
+		  __entry->refill_pend)
+);
+
+#endif /* __QDMA_TRACE_H__ */
+
+/* the header is not under include/trace/events, look it up in -I paths */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE qdma_trace
+#include <trace/define_trace.h>
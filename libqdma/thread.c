@@ -22,6 +22,8 @@
 #include "thread.h"
 
 #include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/timex.h>
 
 /*
  * kernel thread function wrappers
@@ -38,50 +40,90 @@ int qdma_kthread_dump(struct qdma_kthread *thp, char *buf, int buflen,
 	len += snprintf(buf, buflen, "%s, cpu %u, work %u.\n",
 			thp->name, thp->cpu, thp->work_cnt);
 
-	if (detail)
-		;
+	if (detail && len < buflen)
+		len += snprintf(buf + len, buflen - len,
+			"\tspin %u us, busy %llu, idle %llu cycles, sleep %lu.\n",
+			thp->spin_us, thp->busy_cycles, thp->idle_cycles,
+			thp->sleep_cnt);
 
 	unlock_thread(thp);
 
+	if (len >= buflen)
+		len = buflen - 1;
 	buf[len] = '\0';
 	return len;
 }
 
+#define xthread_for_each_work(pos, thp) \
+	for (pos = rcu_dereference(list_next_rcu(&(thp)->work_list)); \
+	     pos != &(thp)->work_list; \
+	     pos = rcu_dereference(list_next_rcu(pos)))
+
 static inline int xthread_work_pending(struct qdma_kthread *thp)
 {
-	struct list_head *work_item, *next;
-
-	/* any work items assigned to this thread? */
-	if (list_empty(&thp->work_list))
-		return 0;
-
+	struct list_head *work_item;
+	int pend = 0;
+
+	rcu_read_lock();
+	xthread_for_each_work(work_item, thp) {
+		if (!thp->fpending || thp->fpending(work_item)) {
+			pend = 1;
+			break;
+		}
+	}
+	rcu_read_unlock();
 
-	/* any work item has pending work to do? */
-	list_for_each_safe(work_item, next, &thp->work_list) {
-		if (thp->fpending && thp->fpending(work_item))
-			return 1;
+	return pend;
+}
 
+/* run the work items that have something pending, returns the number run */
+static inline int xthread_run_work(struct qdma_kthread *thp)
+{
+	struct list_head *work_item;
+	int done = 0;
+
+	rcu_read_lock();
+	xthread_for_each_work(work_item, thp) {
+		if (thp->fpending && !thp->fpending(work_item))
+			continue;
+		thp->fproc(work_item);
+		done++;
 	}
-	return 0;
+	rcu_read_unlock();
+
+	return done;
 }
 
 static inline void xthread_reschedule(struct qdma_kthread *thp)
 {
-	if (thp->kth_timeout) {
-		pr_debug_thread("%s rescheduling for %u seconds",
-				thp->name, thp->kth_timeout);
-		qdma_waitq_wait_event_timeout(
-				thp->waitq, thp->schedule,
-				msecs_to_jiffies(thp->kth_timeout));
-	} else {
-		pr_debug_thread("%s rescheduling", thp->name);
-		qdma_waitq_wait_event(thp->waitq, thp->schedule);
+	WRITE_ONCE(thp->schedule, 0);
+	WRITE_ONCE(thp->sleeping, 1);
+	/* pairs with qdma_kthread_wakeup() */
+	smp_mb();
+
+	if (!xthread_work_pending(thp)) {
+		thp->sleep_cnt++;
+		if (thp->kth_timeout) {
+			pr_debug_thread("%s rescheduling for %u seconds",
+					thp->name, thp->kth_timeout);
+			qdma_waitq_wait_event_timeout(
+					thp->waitq, READ_ONCE(thp->schedule),
+					msecs_to_jiffies(thp->kth_timeout));
+		} else {
+			pr_debug_thread("%s rescheduling", thp->name);
+			qdma_waitq_wait_event(thp->waitq,
+					READ_ONCE(thp->schedule));
+		}
 	}
+
+	WRITE_ONCE(thp->sleeping, 0);
 }
 
 static int xthread_main(void *data)
 {
 	struct qdma_kthread *thp = (struct qdma_kthread *)data;
+	cycles_t last, now;
+	u64 spin_end = 0;
 
 	pr_debug_thread("%s UP.\n", thp->name);
 
@@ -90,32 +132,35 @@ static int xthread_main(void *data)
 	if (thp->finit)
 		thp->finit(thp);
 
-
+	last = get_cycles();
 	while (!kthread_should_stop()) {
-
-		struct list_head *work_item, *next;
-
-		pr_debug_thread("%s interruptible\n", thp->name);
-
-		/* any work to do? */
-		lock_thread(thp);
-		if (!xthread_work_pending(thp)) {
-			unlock_thread(thp);
-			xthread_reschedule(thp);
-			lock_thread(thp);
-		}
-		thp->schedule = 0;
-
-		if (thp->work_cnt) {
-			pr_debug_thread("%s processing %u work items\n",
-					thp->name, thp->work_cnt);
-			/* do work */
-			list_for_each_safe(work_item, next, &thp->work_list) {
-				thp->fproc(work_item);
+		int done = xthread_run_work(thp);
+
+		now = get_cycles();
+		if (done) {
+			pr_debug_thread("%s processed %d work items\n",
+					thp->name, done);
+			thp->busy_cycles += now - last;
+			spin_end = 0;
+		} else {
+			thp->idle_cycles += now - last;
+			/* spin for a while before giving up the cpu */
+			if (!spin_end)
+				spin_end = ktime_get_ns() +
+					(u64)READ_ONCE(thp->spin_us) *
+					NSEC_PER_USEC;
+			if (ktime_get_ns() >= spin_end) {
+				spin_end = 0;
+				xthread_reschedule(thp);
+				last = now;
+				now = get_cycles();
+				thp->idle_cycles += now - last;
+			} else {
+				cpu_relax();
 			}
 		}
-		unlock_thread(thp);
-		schedule();
+		last = now;
+		cond_resched();
 	}
 
 	pr_debug_thread("%s, work done.\n", thp->name);
@@ -27,6 +27,7 @@
 #include <linux/version.h>
 #include <linux/spinlock.h>
 #include <linux/kthread.h>
+#include <linux/rculist.h>
 #include <linux/cpuset.h>
 #include <linux/signal.h>
 #include "qdma_compat.h"
@@ -52,11 +53,24 @@ struct qdma_kthread {
 	qdma_wait_queue waitq;
 	/* flag to indicate scheduling of thread */
 	unsigned int schedule;
+	/* thread is, or is about to be, waiting on waitq */
+	unsigned int sleeping;
+	/**  time to keep polling an idle work list before sleeping, in usecs */
+	unsigned int spin_us;
+	/**  cycles spent processing work items */
+	u64 busy_cycles;
+	/**  cycles spent polling an idle work list or sleeping */
+	u64 idle_cycles;
+	/**  number of times the thread went to sleep */
+	unsigned long sleep_cnt;
 	/**  kernel task structure associated with thread*/
 	struct task_struct *task;
 	/**  thread work list count */
 	unsigned int work_cnt;
-	/**  thread work list count */
+	/**
+	 *  thread work list, rcu protected: walked locklessly by the thread,
+	 *  updated under lock
+	 */
 	struct list_head work_list;
 	/**  thread initialization handler */
 	int (*finit)(struct qdma_kthread *thp);
@@ -98,8 +112,10 @@ int qdma_kthread_dump(struct qdma_kthread *thp, char *buf, int buflen,
 #define qdma_kthread_wakeup(thp)	\
 	do { \
 		pr_debug("signaling thp %s ...\n", (thp)->name); \
-		thp->schedule = 1; \
-		qdma_waitq_wakeup(&thp->waitq); \
+		WRITE_ONCE((thp)->schedule, 1); \
+		smp_mb(); \
+		if (READ_ONCE((thp)->sleeping)) \
+			qdma_waitq_wakeup(&(thp)->waitq); \
 	} while (0)
 
 #define pr_debug_thread(fmt, ...) pr_debug(fmt, __VA_ARGS__)
@@ -109,11 +125,16 @@ int qdma_kthread_dump(struct qdma_kthread *thp, char *buf, int buflen,
 #define lock_thread(thp)		spin_lock(&(thp)->lock)
 /** un lock thread macro */
 #define unlock_thread(thp)		spin_unlock(&(thp)->lock)
-/** macro to wake up the qdma k thread */
+/**
+ * macro to wake up the qdma k thread, a thread still polling its work list
+ * picks the new work up without a wakeup
+ */
 #define qdma_kthread_wakeup(thp) \
 	do { \
-		thp->schedule = 1; \
-		qdma_waitq_wakeup(&thp->waitq); \
+		WRITE_ONCE((thp)->schedule, 1); \
+		smp_mb(); \
+		if (READ_ONCE((thp)->sleeping)) \
+			qdma_waitq_wakeup(&(thp)->waitq); \
 	} while (0)
 /** pr_debug_thread */
 #define pr_debug_thread(fmt, ...)
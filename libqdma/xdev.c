@@ -32,11 +32,15 @@
 #include <linux/sched.h>
 #include <linux/vmalloc.h>
 #include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/workqueue.h>
 
 #include "qdma_regs.h"
 #include "xdev.h"
 #include "qdma_mbox.h"
 #include "qdma_intr.h"
+#include "qdma_thread.h"
 #include "qdma_resource_mgmt.h"
 #include "qdma_access_common.h"
 #ifdef DEBUGFS
@@ -309,6 +313,27 @@ int xdev_list_dump(char *buf, int buflen)
 	return len;
 }
 
+/*****************************************************************************/
+/**
+ * xdev_list_csr_sync() - refresh the cached global csr values of all the
+ *			functions of a dma device
+ *
+ * @param[in]	dma_device_index:	dma device the functions belong to
+ *
+ * @return	none
+ *****************************************************************************/
+void xdev_list_csr_sync(u32 dma_device_index)
+{
+	struct xlnx_dma_dev *xdev, *tmp;
+
+	mutex_lock(&xdev_mutex);
+	list_for_each_entry_safe(xdev, tmp, &xdev_list, list_head) {
+		if (xdev->dma_device_index == dma_device_index)
+			qdma_csr_read(xdev, &xdev->csr_info);
+	}
+	mutex_unlock(&xdev_mutex);
+}
+
 /*****************************************************************************/
 /**
  * xdev_list_add() - add a new node to the xdma device lsit
@@ -456,6 +481,167 @@ int xdev_check_hndl(const char *fname, struct pci_dev *pdev, unsigned long hndl)
 	return 0;
 }
 
+/**********************************************************************
+ * device workqueues
+ **********************************************************************/
+
+static void qdma_wq_max(atomic64_t *max, u64 v)
+{
+	u64 old = atomic64_read(max);
+
+	while (v > old) {
+		u64 cur = atomic64_cmpxchg(max, old, v);
+
+		if (cur == old)
+			break;
+		old = cur;
+	}
+}
+
+static void qdma_wq_queued(struct qdma_wq *wq)
+{
+	int depth = atomic_inc_return(&wq->depth);
+	int old = atomic_read(&wq->depth_max);
+
+	atomic64_inc(&wq->queued);
+	while (depth > old) {
+		int cur = atomic_cmpxchg(&wq->depth_max, old, depth);
+
+		if (cur == old)
+			break;
+		old = cur;
+	}
+}
+
+bool qdma_wq_queue_work(struct qdma_wq *wq, int cpu, struct work_struct *work,
+			u64 *qtime)
+{
+	/* racy against a pending item, good enough for the statistics */
+	if (!work_pending(work))
+		*qtime = ktime_get_ns();
+
+	if (!queue_work_on(cpu, wq->wq, work))
+		return false;
+
+	qdma_wq_queued(wq);
+	return true;
+}
+
+bool qdma_wq_queue_delayed_work(struct qdma_wq *wq,
+			struct delayed_work *dwork, unsigned long delay)
+{
+	if (!queue_delayed_work(wq->wq, dwork, delay))
+		return false;
+
+	qdma_wq_queued(wq);
+	return true;
+}
+
+void qdma_wq_work_start(struct qdma_wq *wq, u64 qtime)
+{
+	atomic64_inc(&wq->run);
+	atomic_dec(&wq->depth);
+
+	if (qtime) {
+		u64 lat = ktime_get_ns() - qtime;
+
+		atomic64_add(lat, &wq->lat_sum);
+		qdma_wq_max(&wq->lat_max, lat);
+	}
+}
+
+bool qdma_wq_cancel_work_sync(struct qdma_wq *wq, struct work_struct *work)
+{
+	if (!cancel_work_sync(work))
+		return false;
+
+	atomic_dec(&wq->depth);
+	return true;
+}
+
+bool qdma_wq_cancel_delayed_work_sync(struct qdma_wq *wq,
+			struct delayed_work *dwork)
+{
+	if (!cancel_delayed_work_sync(dwork))
+		return false;
+
+	atomic_dec(&wq->depth);
+	return true;
+}
+
+void qdma_wq_stats_get(struct qdma_wq *wq, struct qdma_wq_stats *stats)
+{
+	stats->queued = atomic64_read(&wq->queued);
+	stats->run = atomic64_read(&wq->run);
+	stats->depth = max(atomic_read(&wq->depth), 0);
+	stats->depth_max = atomic_read(&wq->depth_max);
+	stats->lat_avg_ns = stats->run ?
+		div64_u64(atomic64_read(&wq->lat_sum), stats->run) : 0;
+	stats->lat_max_ns = atomic64_read(&wq->lat_max);
+}
+
+static void qdma_wq_stats_clear(struct qdma_wq *wq)
+{
+	atomic64_set(&wq->queued, 0);
+	atomic64_set(&wq->run, 0);
+	atomic_set(&wq->depth_max, 0);
+	atomic64_set(&wq->lat_sum, 0);
+	atomic64_set(&wq->lat_max, 0);
+}
+
+/*****************************************************************************/
+/**
+ * xdev_wq_init() - create the device workqueues: a high priority one for
+ *		    the queue work and one for housekeeping
+ *
+ * @param[in]	xdev:	pointer to current xdev
+ *
+ * @return	0: success
+ * @return	<0: on failure
+ *****************************************************************************/
+static int xdev_wq_init(struct xlnx_dma_dev *xdev)
+{
+	const char *name = dev_name(&xdev->conf.pdev->dev);
+	unsigned int flags = WQ_HIGHPRI | WQ_MEM_RECLAIM;
+
+	/* the cpumask of an unbound queue is set through sysfs */
+	if (xdev->conf.wq_unbound)
+		flags |= WQ_UNBOUND | WQ_SYSFS;
+
+	xdev->dp_wq.wq = alloc_workqueue("qdma_dp_%s", flags, 0, name);
+	if (!xdev->dp_wq.wq)
+		return -ENOMEM;
+
+	xdev->hk_wq.wq = alloc_workqueue("qdma_hk_%s", WQ_UNBOUND, 1, name);
+	if (!xdev->hk_wq.wq) {
+		destroy_workqueue(xdev->dp_wq.wq);
+		xdev->dp_wq.wq = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************/
+/**
+ * xdev_wq_destroy() - destroy the device workqueues
+ *
+ * @param[in]	xdev:	pointer to current xdev
+ *
+ * @return	none
+ *****************************************************************************/
+static void xdev_wq_destroy(struct xlnx_dma_dev *xdev)
+{
+	if (xdev->dp_wq.wq) {
+		destroy_workqueue(xdev->dp_wq.wq);
+		xdev->dp_wq.wq = NULL;
+	}
+	if (xdev->hk_wq.wq) {
+		destroy_workqueue(xdev->hk_wq.wq);
+		xdev->hk_wq.wq = NULL;
+	}
+}
+
 /**********************************************************************
  * PCI-level Functions
  **********************************************************************/
@@ -638,11 +824,13 @@ static void qdma_err_mon(struct work_struct *work)
 		pr_err("Invalid xdev");
 		return;
 	}
+	qdma_wq_work_start(&xdev->hk_wq, 0);
 	spin_lock(&xdev->err_lock);
 
 	if (xdev->err_mon_cancel == 0) {
 		xdev->hw.qdma_hw_error_process(xdev);
-		schedule_delayed_work(dwork, msecs_to_jiffies(1000));/* 1 sec */
+		qdma_wq_queue_delayed_work(&xdev->hk_wq, dwork,
+					   msecs_to_jiffies(1000));/* 1 sec */
 	}
 	spin_unlock(&xdev->err_lock);
 }
@@ -719,8 +907,10 @@ int qdma_device_offline(struct pci_dev *pdev, unsigned long dev_hndl,
 		pr_debug("Cancelling delayed work");
 		spin_lock(&xdev->err_lock);
 		xdev->err_mon_cancel = 1;
-		cancel_delayed_work_sync(&xdev->err_mon);
 		spin_unlock(&xdev->err_lock);
+		/* qdma_err_mon() takes err_lock, wait for it unlocked */
+		qdma_wq_cancel_delayed_work_sync(&xdev->hk_wq,
+						 &xdev->err_mon);
 	}
 #endif
 
@@ -894,8 +1084,8 @@ int qdma_device_online(struct pci_dev *pdev, unsigned long dev_hndl, int reset)
 		spin_lock_init(&xdev->err_lock);
 		xdev->err_mon_cancel = 0;
 		INIT_DELAYED_WORK(&xdev->err_mon, qdma_err_mon);
-		schedule_delayed_work(&xdev->err_mon,
-				      msecs_to_jiffies(1000));
+		qdma_wq_queue_delayed_work(&xdev->hk_wq, &xdev->err_mon,
+					   msecs_to_jiffies(1000));
 	}
 
 	/**
@@ -1033,6 +1223,13 @@ int qdma_device_open(const char *mod_name, struct qdma_dev_conf *conf,
 		goto disable_device;
 	}
 
+	rv = xdev_wq_init(xdev);
+	if (rv < 0) {
+		pr_err("Failed to create the workqueues");
+		kfree(xdev);
+		goto disable_device;
+	}
+
 	strncpy(xdev->mod_name, mod_name, QDMA_DEV_NAME_MAXLEN - 1);
 
 	xdev_flag_set(xdev, XDEV_FLAG_OFFLINE);
@@ -1159,6 +1356,15 @@ int qdma_device_open(const char *mod_name, struct qdma_dev_conf *conf,
 		goto unmap_bars;
 	}
 
+	/** poll mode queues are serviced by the completion status threads */
+	if (xdev->conf.qdma_drv_mode == POLL_MODE) {
+		rv = qdma_threads_get();
+		if (rv < 0) {
+			pr_err("Failed to start the poll threads, err %d", rv);
+			goto cleanup_qdma;
+		}
+	}
+
 	pr_info("%s, %05x, pdev 0x%p, xdev 0x%p, ch %u, q %u, vf %u.\n",
 		dev_name(&pdev->dev), xdev->conf.bdf, pdev, xdev,
 		xdev->dev_cap.mm_channel_max, conf->qsets_max, conf->vf_max);
@@ -1178,6 +1384,7 @@ cleanup_qdma:
 unmap_bars:
 	xdev_unmap_bars(xdev, pdev);
 	xdev_list_remove(xdev);
+	xdev_wq_destroy(xdev);
 	kfree(xdev);
 
 disable_device:
@@ -1223,6 +1430,9 @@ int qdma_device_close(struct pci_dev *pdev, unsigned long dev_hndl)
 
 	qdma_device_offline(pdev, dev_hndl, XDEV_FLR_INACTIVE);
 
+	if (xdev->conf.qdma_drv_mode == POLL_MODE)
+		qdma_threads_put();
+
 #ifdef DEBUGFS
 	/** time to clean debugfs */
 	dbgfs_dev_exit(xdev);
@@ -1241,6 +1451,7 @@ int qdma_device_close(struct pci_dev *pdev, unsigned long dev_hndl)
 
 	xdev_list_remove(xdev);
 
+	xdev_wq_destroy(xdev);
 	kfree(xdev);
 
 	return 0;
@@ -1310,6 +1521,32 @@ int qdma_device_clear_stats(unsigned long dev_hndl)
 	xdev->ping_pong_lat_max = 0;
 	xdev->ping_pong_lat_min = 0;
 	xdev->ping_pong_lat_total = 0;
+	qdma_wq_stats_clear(&xdev->dp_wq);
+	qdma_wq_stats_clear(&xdev->hk_wq);
+
+	return 0;
+}
+
+int qdma_device_get_wq_stats(unsigned long dev_hndl,
+			struct qdma_wq_stats *dp, struct qdma_wq_stats *hk)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *) dev_hndl;
+
+	/** make sure that the dev_hndl passed is Valid */
+	if (!xdev) {
+		pr_err("dev_hndl is NULL");
+		return -EINVAL;
+	}
+
+	if (xdev_check_hndl(__func__, xdev->conf.pdev, dev_hndl) < 0) {
+		pr_err("Invalid dev_hndl passed");
+		return -EINVAL;
+	}
+
+	if (dp)
+		qdma_wq_stats_get(&xdev->dp_wq, dp);
+	if (hk)
+		qdma_wq_stats_get(&xdev->hk_wq, hk);
 
 	return 0;
 }
@@ -28,6 +28,7 @@
 #include <linux/dma-mapping.h>
 #include <linux/interrupt.h>
 #include <linux/pci.h>
+#include <linux/workqueue.h>
 
 #include "libqdma_export.h"
 #include "qdma_mbox.h"
@@ -197,12 +198,41 @@ struct intr_vec_map_type {
 	f_intr_handler intr_handler;	/**< interrupt handler */
 };
 
+struct qdma_descq;
+
+/**
+ * @struct - intr_q_tbl
+ * @brief	queues serviced by an interrupt vector, replaced as a whole
+ *		under vec_q_list and read under rcu in the interrupt handler
+ */
+struct intr_q_tbl {
+	struct rcu_head rcu;		/**< rcu head for the deferred free */
+	int cnt;			/**< number of slots */
+	struct qdma_descq *descq[];	/**< queues, a slot may be NULL */
+};
+
+/**
+ * @struct - qdma_wq
+ * @brief	device workqueue and its accounting
+ */
+struct qdma_wq {
+	struct workqueue_struct *wq;	/**< workqueue */
+	atomic64_t queued;		/**< work items queued */
+	atomic64_t run;			/**< work items run */
+	atomic_t depth;			/**< work items queued, not run yet */
+	atomic_t depth_max;		/**< max. depth seen */
+	atomic64_t lat_sum;		/**< sum of queue to run latencies, ns */
+	atomic64_t lat_max;		/**< max. queue to run latency, ns */
+};
+
 /**< Interrupt info for MSI-X interrupt vectors per device */
 struct intr_info_t {
 	/**< msix_entry list for all vectors */
 	char msix_name[QDMA_DEV_NAME_MAXLEN + 16];
-	/**< queue list for each interrupt */
-	struct list_head intr_list;
+	/**< device of the vector, the vector's dev_id points here */
+	struct xlnx_dma_dev *xdev;
+	/**< queue table for each interrupt */
+	struct intr_q_tbl __rcu *q_tbl;
 	/**< number of queues assigned for each interrupt */
 	int intr_list_cnt;
 	/**< interrupt vector map */
@@ -284,6 +314,8 @@ struct xlnx_dma_dev {
 	void *dev_priv;
 	/**< list of interrupt coalescing configuration for each vector */
 	struct intr_coal_conf  *intr_coal_list;
+	/**< number of entries in intr_coal_list, one ring per data vector */
+	int intr_ring_cnt;
 	/**< legacy interrupt vector */
 	int vector_legacy;
 	/**< error lock */
@@ -292,6 +324,10 @@ struct xlnx_dma_dev {
 	u8 err_mon_cancel;
 	/**< error minitor work handler */
 	struct delayed_work err_mon;
+	/**< high priority workqueue for the queue work */
+	struct qdma_wq dp_wq;
+	/**< workqueue for housekeeping, e.g. the error monitor */
+	struct qdma_wq hk_wq;
 #ifdef DEBUGFS
 	/** debugfs device root */
 	struct dentry *dbgfs_dev_root;
@@ -473,6 +509,17 @@ struct xlnx_dma_dev *xdev_list_next(struct xlnx_dma_dev *xdev);
  *****************************************************************************/
 int xdev_list_dump(char *buf, int buflen);
 
+/*****************************************************************************/
+/**
+ * xdev_list_csr_sync() - refresh the cached global csr values of all the
+ *			functions of a dma device
+ *
+ * @param[in]	dma_device_index:	dma device the functions belong to
+ *
+ * @return	none
+ *****************************************************************************/
+void xdev_list_csr_sync(u32 dma_device_index);
+
 /*****************************************************************************/
 /**
  * xdev_check_hndl() - helper function to validate the device handle
@@ -487,6 +534,80 @@ int xdev_list_dump(char *buf, int buflen);
 int xdev_check_hndl(const char *fname,
 			struct pci_dev *pdev, unsigned long hndl);
 
+/*****************************************************************************/
+/**
+ * qdma_wq_queue_work() - queue a work item on a device workqueue
+ *
+ * @param[in]	wq:	device workqueue
+ * @param[in]	cpu:	cpu to run on, or WORK_CPU_UNBOUND
+ * @param[in]	work:	work item
+ * @param[out]	qtime:	queueing timestamp, passed to qdma_wq_work_start()
+ *
+ * @return	true if queued, false if it was already pending
+ *****************************************************************************/
+bool qdma_wq_queue_work(struct qdma_wq *wq, int cpu, struct work_struct *work,
+			u64 *qtime);
+
+/*****************************************************************************/
+/**
+ * qdma_wq_queue_delayed_work() - queue a delayed work item on a device
+ *				  workqueue
+ *
+ * @param[in]	wq:	device workqueue
+ * @param[in]	dwork:	delayed work item
+ * @param[in]	delay:	delay in jiffies
+ *
+ * @return	true if queued, false if it was already pending
+ *****************************************************************************/
+bool qdma_wq_queue_delayed_work(struct qdma_wq *wq,
+			struct delayed_work *dwork, unsigned long delay);
+
+/*****************************************************************************/
+/**
+ * qdma_wq_work_start() - account a work item of a device workqueue starting
+ *
+ * @param[in]	wq:	device workqueue
+ * @param[in]	qtime:	queueing timestamp, 0 if unknown
+ *
+ * @return	none
+ *****************************************************************************/
+void qdma_wq_work_start(struct qdma_wq *wq, u64 qtime);
+
+/*****************************************************************************/
+/**
+ * qdma_wq_cancel_work_sync() - cancel a work item of a device workqueue
+ *
+ * @param[in]	wq:	device workqueue
+ * @param[in]	work:	work item
+ *
+ * @return	true if the work item was pending
+ *****************************************************************************/
+bool qdma_wq_cancel_work_sync(struct qdma_wq *wq, struct work_struct *work);
+
+/*****************************************************************************/
+/**
+ * qdma_wq_cancel_delayed_work_sync() - cancel a delayed work item of a device
+ *					workqueue
+ *
+ * @param[in]	wq:	device workqueue
+ * @param[in]	dwork:	delayed work item
+ *
+ * @return	true if the work item was pending
+ *****************************************************************************/
+bool qdma_wq_cancel_delayed_work_sync(struct qdma_wq *wq,
+			struct delayed_work *dwork);
+
+/*****************************************************************************/
+/**
+ * qdma_wq_stats_get() - snapshot the accounting of a device workqueue
+ *
+ * @param[in]	wq:	device workqueue
+ * @param[out]	stats:	workqueue statistics
+ *
+ * @return	none
+ *****************************************************************************/
+void qdma_wq_stats_get(struct qdma_wq *wq, struct qdma_wq_stats *stats);
+
 
 #ifdef __QDMA_VF__
 /*****************************************************************************/
@@ -3,6 +3,8 @@
 
 #include <linux/netdevice.h>
 #include <linux/cpumask.h>
+#include <linux/interrupt.h>
+#include <linux/dim.h>
 #include "onic_json.h"
 #include "libqdma_export.h"
 #include "onic_register.h"
@@ -14,6 +16,28 @@
 #define ONIC_RX_COPY_THRES                  (256)
 #define ONIC_RX_PULL_LEN                    (128)
 #define ONIC_NAPI_WEIGHT                    (64)
+#define ONIC_INTR_RING_ENTRIES              (512)
+#define ONIC_RX_COPY_UTIL_PCT               (25)
+/* a Tx queue is woken once this many requests fit in its request ring */
+#define ONIC_TX_WAKE_THRES                  (32)
+
+/* 16B completion entry user defined data: dword 2 carries the Toeplitz
+ * hash computed by the shell, the low bits of dword 3 its type
+ */
+#define ONIC_CMPL_HASH_DW                   (2)
+#define ONIC_CMPL_HASH_TYPE_MASK            (0x3)
+#define ONIC_CMPL_HASH_TYPE_NONE            (0)
+#define ONIC_CMPL_HASH_TYPE_L3              (1)
+#define ONIC_CMPL_HASH_TYPE_L4              (2)
+
+/* ethtool private flags */
+#define ONIC_PRIV_FLAG_RX_COPY_LOW_UTIL     BIT(0)
+#define ONIC_PRIV_FLAG_LOW_LATENCY          BIT(1)
+#define ONIC_PRIV_FLAG_BALANCED             BIT(2)
+#define ONIC_PRIV_FLAG_BULK_THROUGHPUT      BIT(3)
+#define ONIC_PRIV_FLAG_PROFILES             (ONIC_PRIV_FLAG_LOW_LATENCY | \
+					     ONIC_PRIV_FLAG_BALANCED | \
+					     ONIC_PRIV_FLAG_BULK_THROUGHPUT)
 
 
 struct onic_dma_request {
@@ -23,31 +47,95 @@ struct onic_dma_request {
 	struct qdma_sw_sg sgl[MAX_SKB_FRAGS];
 };
 
+/* Per queue net_dim context */
+struct onic_dim {
+	struct dim dim;
+	struct onic_priv *xpriv;
+	u16 q_no;
+	u16 event_ctr;
+	/* global CSR slots selected by net_dim, see onic_rx_dim_work() */
+	u8 timer_idx, cnt_th_idx;
+	unsigned long csr_refs;
+};
+
+/* Per queue pair irq affinity context */
+struct onic_irq_aff {
+	struct irq_affinity_notify notify;
+	struct onic_priv *xpriv;
+	u16 q_no;
+	int irq;
+	int tx_irq;
+	/* cpu of the rx vector, shared by the queue pairs on the vector */
+	int cpu;
+};
+
+/* global CSR slots referenced by the indexes of struct onic_priv */
+enum onic_csr_ref {
+	ONIC_CSR_REF_RING_SZ,
+	ONIC_CSR_REF_TIMER,
+	ONIC_CSR_REF_CNT_TH,
+	ONIC_CSR_REF_BUF_SZ,
+	ONIC_CSR_REF_SMALL_BUF_SZ,
+	ONIC_CSR_REF_MAX
+};
+
 /* ONIC Net device private structure */
 struct onic_priv {
 	u8 rx_desc_rng_sz_idx;
 	u8 tx_desc_rng_sz_idx;
 	u8 rx_buf_sz_idx;
+	u8 rx_small_buf_sz_idx;
 	u8 rx_timer_idx;
 	u8 rx_cnt_th_idx;
 	u8 cmpl_rng_sz_idx;
+	u8 rx_trig_mode;
+	u8 tx_pidx_acc;
+	unsigned long csr_refs;
+	bool adaptive_rx;
+	bool adaptive_tx;
+	u16 tx_usecs;
+	u16 tx_frames;
+	u32 priv_flags;
 
 	struct net_device *netdev;
 	struct pci_dev *pcidev;
 	struct onic_platform_info *pinfo;
 
 	u16 num_msix;
+	u16 nb_data_vecs;
 	u16 nb_queues;
 
 	struct kmem_cache *dma_req;
 	struct qdma_dev_conf qdma_dev_conf;
 	unsigned long dev_handle;
 	void __iomem *bar_base;
+	struct global_csr_conf csr_conf;
 
 	unsigned long base_tx_q_handle, base_rx_q_handle;
 	struct napi_struct *napi;
+	struct onic_dim *rx_dim;
+	struct onic_dim *tx_dim;
+	/* fast path handles, resolved once after qdma_queue_add() */
+	struct qdma_descq **rx_q_fp, **tx_q_fp;
+	struct onic_irq_aff *irq_aff;
 	struct rtnl_link_stats64 *tx_qstats, *rx_qstats;
 
 };
 
+int onic_open(struct net_device *netdev);
+int onic_stop(struct net_device *netdev);
+u8 onic_csr_closest_idx(unsigned int *arr, unsigned int value);
+int onic_csr_closest_slot_get(struct onic_priv *xpriv,
+			      enum qdma_global_csr_type type,
+			      unsigned int value, u8 *idx);
+void onic_rx_dim_slots_put(struct onic_priv *xpriv, u16 q_no);
+int onic_csr_slot_get(struct onic_priv *xpriv,
+		      enum qdma_global_csr_type type, unsigned int value,
+		      u8 *idx);
+void onic_csr_slots_release(struct onic_priv *xpriv);
+int onic_set_rx_cmpl_ctrl(struct onic_priv *xpriv, u16 q_no, u8 timer_idx,
+			  u8 cnt_th_idx);
+int onic_set_tx_irq_moder(struct onic_priv *xpriv, u16 q_no, u16 frames,
+			  u16 usecs);
+
 #endif /* ONIC_H */
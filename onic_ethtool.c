@@ -1,6 +1,7 @@
 #include <linux/pci.h>
 #include <linux/netdevice.h>
 #include <linux/ethtool.h>
+#include <linux/version.h>
 
 #include "onic.h"
 
@@ -19,9 +20,450 @@ static void onic_get_drvinfo(struct net_device *netdev,
 		sizeof(drvinfo->bus_info));
 }
 
+static const char onic_priv_flags_strings[][ETH_GSTRING_LEN] = {
+	"rx-copy-low-util",
+	"low-latency",
+	"balanced",
+	"bulk-throughput",
+};
+
+/* Tuning profile selected by a private flag, a zero field keeps the value
+ * of the json file
+ */
+struct onic_profile {
+	u32 flag;
+	bool adaptive_rx;
+	unsigned int rx_usecs;
+	unsigned int rx_frames;
+	unsigned int ring_sz;
+	u8 rx_trig_mode;
+	u8 tx_pidx_acc;
+	bool adaptive_tx;
+	u16 tx_usecs;
+	u16 tx_frames;
+};
+
+static const struct onic_profile onic_profiles[] = {
+	/* every completion is reported right away, short rings */
+	{ ONIC_PRIV_FLAG_LOW_LATENCY, false, 1, 1, 512, TRIG_MODE_ANY, 0,
+	  false, 0, 0 },
+	/* json settings tuned by net_dim */
+	{ ONIC_PRIV_FLAG_BALANCED, true, 0, 0, 0, TRIG_MODE_COMBO, 0,
+	  true, 0, 0 },
+	/* long rings, coarse coalescing and batched Tx doorbells */
+	{ ONIC_PRIV_FLAG_BULK_THROUGHPUT, false, 50, 64, 4096,
+	  TRIG_MODE_COMBO, 32, false, 100, 64 },
+};
+
+/* settings of the json file, used when no profile is selected */
+static const struct onic_profile onic_profile_default = {
+	0, false, 0, 0, 0, TRIG_MODE_COMBO, 0, false, 0, 0
+};
+
+#define ONIC_PRIV_FLAGS_COUNT ARRAY_SIZE(onic_priv_flags_strings)
+
+static int onic_get_sset_count(struct net_device *netdev, int sset)
+{
+	switch (sset) {
+	case ETH_SS_PRIV_FLAGS:
+		return ONIC_PRIV_FLAGS_COUNT;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static void onic_get_strings(struct net_device *netdev, u32 sset, u8 *data)
+{
+	switch (sset) {
+	case ETH_SS_PRIV_FLAGS:
+		memcpy(data, onic_priv_flags_strings,
+		       sizeof(onic_priv_flags_strings));
+		break;
+	default:
+		break;
+	}
+}
+
+static u32 onic_get_priv_flags(struct net_device *netdev)
+{
+	struct onic_priv *xpriv = netdev_priv(netdev);
+
+	return xpriv->priv_flags;
+}
+
+/* This function takes a reference on a global CSR slot holding the timer or
+ * counter threshold value, or falls back to the closest slot. It returns
+ * whether a reference is held.
+ */
+static bool onic_rx_cmpl_slot_get(struct onic_priv *xpriv,
+				  enum qdma_global_csr_type type,
+				  unsigned int value, u8 *idx)
+{
+	unsigned int *arr = (type == QDMA_CSR_TIMER_CNT) ?
+			    xpriv->csr_conf.c2h_timer_cnt :
+			    xpriv->csr_conf.c2h_cnt_th;
+	bool ref;
+
+	if (!onic_csr_slot_get(xpriv, type, value, idx))
+		return true;
+
+	ref = !onic_csr_closest_slot_get(xpriv, type, value, idx);
+
+	/* the cached values back onic_get_coalesce() */
+	qdma_global_csr_get(xpriv->dev_handle, 0, QDMA_GLOBAL_CSR_ARRAY_SZ,
+			    &xpriv->csr_conf);
+	if (!ref)
+		*idx = onic_csr_closest_idx(arr, value);
+	return ref;
+}
+
+/* This function switches the Rx completion settings, reprograms the running
+ * queues when they use static settings, and then releases the slots
+ * previously referenced
+ */
+static void onic_rx_cmpl_set(struct onic_priv *xpriv, bool running,
+			     u8 timer_idx, bool timer_ref, u8 cnt_th_idx,
+			     bool cnt_th_ref, bool adaptive_rx, bool update)
+{
+	struct net_device *netdev = xpriv->netdev;
+	unsigned long old_refs = xpriv->csr_refs;
+	u8 old_timer_idx = xpriv->rx_timer_idx;
+	u8 old_cnt_th_idx = xpriv->rx_cnt_th_idx;
+	int q_no;
+
+	update |= (timer_idx != xpriv->rx_timer_idx ||
+		   cnt_th_idx != xpriv->rx_cnt_th_idx ||
+		   adaptive_rx != xpriv->adaptive_rx);
+
+	xpriv->rx_timer_idx = timer_idx;
+	xpriv->rx_cnt_th_idx = cnt_th_idx;
+	xpriv->adaptive_rx = adaptive_rx;
+	if (timer_ref)
+		set_bit(ONIC_CSR_REF_TIMER, &xpriv->csr_refs);
+	else
+		clear_bit(ONIC_CSR_REF_TIMER, &xpriv->csr_refs);
+	if (cnt_th_ref)
+		set_bit(ONIC_CSR_REF_CNT_TH, &xpriv->csr_refs);
+	else
+		clear_bit(ONIC_CSR_REF_CNT_TH, &xpriv->csr_refs);
+
+	/* apply the static completion settings to the running queues */
+	if (update && !adaptive_rx && running) {
+		for (q_no = 0; q_no < netdev->real_num_rx_queues; q_no++) {
+			cancel_work_sync(&xpriv->rx_dim[q_no].dim.work);
+			onic_set_rx_cmpl_ctrl(xpriv, q_no, xpriv->rx_timer_idx,
+					      xpriv->rx_cnt_th_idx);
+			onic_rx_dim_slots_put(xpriv, q_no);
+		}
+	}
+
+	/* the queues moved off the previous slots, release them */
+	if (test_bit(ONIC_CSR_REF_TIMER, &old_refs))
+		qdma_global_csr_slot_put(xpriv->dev_handle, QDMA_CSR_TIMER_CNT,
+					 old_timer_idx);
+	if (test_bit(ONIC_CSR_REF_CNT_TH, &old_refs))
+		qdma_global_csr_slot_put(xpriv->dev_handle, QDMA_CSR_CNT_TH,
+					 old_cnt_th_idx);
+}
+
+/* This function switches the Tx interrupt moderation and applies the static
+ * settings to the running queues
+ */
+static void onic_tx_moder_set(struct onic_priv *xpriv, bool running,
+			      u16 frames, u16 usecs, bool adaptive_tx)
+{
+	struct net_device *netdev = xpriv->netdev;
+	bool update;
+	int q_no;
+
+	update = (frames != xpriv->tx_frames || usecs != xpriv->tx_usecs ||
+		  adaptive_tx != xpriv->adaptive_tx);
+
+	xpriv->tx_frames = frames;
+	xpriv->tx_usecs = usecs;
+	xpriv->adaptive_tx = adaptive_tx;
+	if (!update || adaptive_tx || !running || xpriv->pinfo->poll_mode)
+		return;
+
+	for (q_no = 0; q_no < netdev->real_num_tx_queues; q_no++) {
+		cancel_work_sync(&xpriv->tx_dim[q_no].dim.work);
+		onic_set_tx_irq_moder(xpriv, q_no, frames, usecs);
+	}
+}
+
+/* This function switches the ring size and the Tx doorbell batching, the
+ * reference on the ring size slot of ring_idx is taken over from the caller
+ */
+static void onic_ring_set(struct onic_priv *xpriv, u8 ring_idx, u8 pidx_acc)
+{
+	u8 old_ring_idx = xpriv->tx_desc_rng_sz_idx;
+	bool old_ring_ref;
+
+	old_ring_ref = test_and_set_bit(ONIC_CSR_REF_RING_SZ, &xpriv->csr_refs);
+	xpriv->tx_desc_rng_sz_idx = ring_idx;
+	xpriv->rx_desc_rng_sz_idx = ring_idx;
+	xpriv->cmpl_rng_sz_idx = ring_idx;
+	xpriv->tx_pidx_acc = pidx_acc;
+
+	if (old_ring_ref)
+		qdma_global_csr_slot_put(xpriv->dev_handle, QDMA_CSR_RING_SZ,
+					 old_ring_idx);
+}
+
+/* This function restarts the queues with a new ring size and Tx doorbell
+ * batching. When the queues cannot be set up with them, the previous
+ * settings are restored and the queues are restarted again, and the
+ * interface is closed if that fails too. The reference on the ring size
+ * slot of ring_idx is taken over on success and dropped otherwise.
+ */
+static int onic_ring_restart(struct onic_priv *xpriv, u8 ring_idx,
+			     u8 pidx_acc)
+{
+	struct net_device *netdev = xpriv->netdev;
+	u8 old_tx_idx = xpriv->tx_desc_rng_sz_idx;
+	u8 old_rx_idx = xpriv->rx_desc_rng_sz_idx;
+	u8 old_cmpl_idx = xpriv->cmpl_rng_sz_idx;
+	u8 old_pidx_acc = xpriv->tx_pidx_acc;
+	int ret, err;
+
+	onic_stop(netdev);
+
+	xpriv->tx_desc_rng_sz_idx = ring_idx;
+	xpriv->rx_desc_rng_sz_idx = ring_idx;
+	xpriv->cmpl_rng_sz_idx = ring_idx;
+	xpriv->tx_pidx_acc = pidx_acc;
+	ret = onic_open(netdev);
+	if (!ret) {
+		if (test_and_set_bit(ONIC_CSR_REF_RING_SZ, &xpriv->csr_refs))
+			qdma_global_csr_slot_put(xpriv->dev_handle,
+						 QDMA_CSR_RING_SZ, old_tx_idx);
+		return 0;
+	}
+
+	netdev_err(netdev, "%s: onic_open() failed with status %d, restoring the previous rings\n",
+		   __func__, ret);
+	qdma_global_csr_slot_put(xpriv->dev_handle, QDMA_CSR_RING_SZ, ring_idx);
+	xpriv->tx_desc_rng_sz_idx = old_tx_idx;
+	xpriv->rx_desc_rng_sz_idx = old_rx_idx;
+	xpriv->cmpl_rng_sz_idx = old_cmpl_idx;
+	xpriv->tx_pidx_acc = old_pidx_acc;
+
+	err = onic_open(netdev);
+	if (err) {
+		netdev_err(netdev, "%s: onic_open() failed with status %d, closing the interface\n",
+			   __func__, err);
+		dev_close(netdev);
+	}
+
+	return ret;
+}
+
+/* This function applies a tuning profile to all the queues. The slots are
+ * referenced before the queues are touched, the queues are restarted when
+ * the ring size or the Tx doorbell batching changes. The running queues
+ * still reference the current ring size slot, so a new ring size takes a
+ * slot no started queue of the card uses, and fails with -ENOSPC when there
+ * is none. Nothing is changed when the slot get or the restart fails.
+ */
+static int onic_profile_apply(struct onic_priv *xpriv,
+			      const struct onic_profile *prof)
+{
+	struct onic_platform_info *pinfo = xpriv->pinfo;
+	struct net_device *netdev = xpriv->netdev;
+	bool running = netif_running(netdev);
+	u8 ring_idx, timer_idx, cnt_th_idx;
+	bool timer_ref, cnt_th_ref, update;
+	int ret, q_no;
+
+	ret = onic_csr_slot_get(xpriv, QDMA_CSR_RING_SZ,
+				prof->ring_sz ? prof->ring_sz : pinfo->ring_sz,
+				&ring_idx);
+	if (ret < 0) {
+		netdev_err(netdev, "%s: no global CSR slot for ring size %u, err %d\n",
+			   __func__,
+			   prof->ring_sz ? prof->ring_sz : pinfo->ring_sz, ret);
+		return ret;
+	}
+	timer_ref = onic_rx_cmpl_slot_get(xpriv, QDMA_CSR_TIMER_CNT,
+					  prof->rx_usecs ? prof->rx_usecs :
+					  pinfo->c2h_tmr_cnt, &timer_idx);
+	cnt_th_ref = onic_rx_cmpl_slot_get(xpriv, QDMA_CSR_CNT_TH,
+					   prof->rx_frames ? prof->rx_frames :
+					   pinfo->c2h_cnt_thr, &cnt_th_idx);
+
+	if (running && (ring_idx != xpriv->tx_desc_rng_sz_idx ||
+			prof->tx_pidx_acc != xpriv->tx_pidx_acc)) {
+		ret = onic_ring_restart(xpriv, ring_idx, prof->tx_pidx_acc);
+		if (ret < 0) {
+			if (timer_ref)
+				qdma_global_csr_slot_put(xpriv->dev_handle,
+							 QDMA_CSR_TIMER_CNT,
+							 timer_idx);
+			if (cnt_th_ref)
+				qdma_global_csr_slot_put(xpriv->dev_handle,
+							 QDMA_CSR_CNT_TH,
+							 cnt_th_idx);
+			return ret;
+		}
+	} else {
+		onic_ring_set(xpriv, ring_idx, prof->tx_pidx_acc);
+	}
+
+	/* restarted queues came up with the previous completion and Tx
+	 * moderation settings and net_dim keeps the trigger mode they were
+	 * started with, so they are reprogrammed like running ones
+	 */
+	update = (prof->rx_trig_mode != xpriv->rx_trig_mode);
+	xpriv->rx_trig_mode = prof->rx_trig_mode;
+	onic_rx_cmpl_set(xpriv, running, timer_idx, timer_ref,
+			 cnt_th_idx, cnt_th_ref,
+			 prof->adaptive_rx && !pinfo->poll_mode, update);
+	if (update && running && xpriv->adaptive_rx) {
+		for (q_no = 0; q_no < netdev->real_num_rx_queues; q_no++)
+			onic_set_rx_cmpl_ctrl(xpriv, q_no, xpriv->rx_timer_idx,
+					      xpriv->rx_cnt_th_idx);
+	}
+
+	onic_tx_moder_set(xpriv, running, prof->tx_frames, prof->tx_usecs,
+			  prof->adaptive_tx && !pinfo->poll_mode);
+
+	return 0;
+}
+
+static int onic_set_priv_flags(struct net_device *netdev, u32 flags)
+{
+	struct onic_priv *xpriv = netdev_priv(netdev);
+	const struct onic_profile *prof = &onic_profile_default;
+	u32 profile = flags & ONIC_PRIV_FLAG_PROFILES;
+	int ret, i;
+
+	if (flags & ~(BIT(ONIC_PRIV_FLAGS_COUNT) - 1))
+		return -EINVAL;
+
+	/* the profiles are exclusive */
+	if (hweight32(profile) > 1) {
+		netdev_err(netdev, "%s: only one profile can be selected\n",
+			   __func__);
+		return -EINVAL;
+	}
+
+	if (profile != (xpriv->priv_flags & ONIC_PRIV_FLAG_PROFILES)) {
+		for (i = 0; i < ARRAY_SIZE(onic_profiles); i++) {
+			if (onic_profiles[i].flag == profile)
+				prof = &onic_profiles[i];
+		}
+
+		ret = onic_profile_apply(xpriv, prof);
+		if (ret < 0)
+			return ret;
+	}
+
+	xpriv->priv_flags = flags;
+
+	return 0;
+}
+
+#if KERNEL_VERSION(5, 15, 0) <= LINUX_VERSION_CODE
+static int onic_get_coalesce(struct net_device *netdev,
+			     struct ethtool_coalesce *ec,
+			     struct kernel_ethtool_coalesce *kernel_coal,
+			     struct netlink_ext_ack *extack)
+#else
+static int onic_get_coalesce(struct net_device *netdev,
+			     struct ethtool_coalesce *ec)
+#endif
+{
+	struct onic_priv *xpriv = netdev_priv(netdev);
+	struct global_csr_conf *csr_conf = &xpriv->csr_conf;
+
+	ec->use_adaptive_rx_coalesce = xpriv->adaptive_rx;
+	ec->rx_coalesce_usecs = csr_conf->c2h_timer_cnt[xpriv->rx_timer_idx];
+	ec->rx_max_coalesced_frames = csr_conf->c2h_cnt_th[xpriv->rx_cnt_th_idx];
+	ec->use_adaptive_tx_coalesce = xpriv->adaptive_tx;
+	ec->tx_coalesce_usecs = xpriv->tx_usecs;
+	ec->tx_max_coalesced_frames = xpriv->tx_frames;
+
+	return 0;
+}
+
+#if KERNEL_VERSION(5, 15, 0) <= LINUX_VERSION_CODE
+static int onic_set_coalesce(struct net_device *netdev,
+			     struct ethtool_coalesce *ec,
+			     struct kernel_ethtool_coalesce *kernel_coal,
+			     struct netlink_ext_ack *extack)
+#else
+static int onic_set_coalesce(struct net_device *netdev,
+			     struct ethtool_coalesce *ec)
+#endif
+{
+	struct onic_priv *xpriv = netdev_priv(netdev);
+	bool adaptive_rx = !!ec->use_adaptive_rx_coalesce;
+	bool adaptive_tx = !!ec->use_adaptive_tx_coalesce;
+	u8 timer_idx, cnt_th_idx;
+	bool timer_ref, cnt_th_ref;
+
+	if ((adaptive_rx || adaptive_tx) && xpriv->pinfo->poll_mode) {
+		netdev_err(netdev, "%s: adaptive coalescing is not supported in poll mode\n",
+			   __func__);
+		return -EOPNOTSUPP;
+	}
+
+	/* the Tx interrupt is armed every tx-frames descriptors, the timer
+	 * services the queue in between
+	 */
+	if (ec->tx_max_coalesced_frames > U16_MAX ||
+	    ec->tx_coalesce_usecs > U16_MAX ||
+	    (ec->tx_max_coalesced_frames > 1 && !ec->tx_coalesce_usecs)) {
+		netdev_err(netdev, "%s: tx-frames needs tx-usecs, both up to %u\n",
+			   __func__, U16_MAX);
+		return -EINVAL;
+	}
+
+	/* the timer and threshold come from the global CSR slots shared by the
+	 * card, reference a slot holding the exact value if one is available
+	 * and take the closest one otherwise
+	 */
+	timer_ref = onic_rx_cmpl_slot_get(xpriv, QDMA_CSR_TIMER_CNT,
+					  ec->rx_coalesce_usecs, &timer_idx);
+	cnt_th_ref = onic_rx_cmpl_slot_get(xpriv, QDMA_CSR_CNT_TH,
+					   ec->rx_max_coalesced_frames,
+					   &cnt_th_idx);
+
+	/* the settings no longer follow the selected profile */
+	if (timer_idx != xpriv->rx_timer_idx ||
+	    cnt_th_idx != xpriv->rx_cnt_th_idx ||
+	    adaptive_rx != xpriv->adaptive_rx ||
+	    ec->tx_max_coalesced_frames != xpriv->tx_frames ||
+	    ec->tx_coalesce_usecs != xpriv->tx_usecs ||
+	    adaptive_tx != xpriv->adaptive_tx)
+		xpriv->priv_flags &= ~ONIC_PRIV_FLAG_PROFILES;
+
+	onic_rx_cmpl_set(xpriv, netif_running(netdev), timer_idx, timer_ref,
+			 cnt_th_idx, cnt_th_ref, adaptive_rx, false);
+	onic_tx_moder_set(xpriv, netif_running(netdev),
+			  ec->tx_max_coalesced_frames, ec->tx_coalesce_usecs,
+			  adaptive_tx);
+
+	return 0;
+}
+
 static const struct ethtool_ops onic_ethtool_ops = {
+#if KERNEL_VERSION(5, 7, 0) <= LINUX_VERSION_CODE
+	.supported_coalesce_params = ETHTOOL_COALESCE_USE_ADAPTIVE_RX |
+				     ETHTOOL_COALESCE_RX_USECS |
+				     ETHTOOL_COALESCE_RX_MAX_FRAMES |
+				     ETHTOOL_COALESCE_USE_ADAPTIVE_TX |
+				     ETHTOOL_COALESCE_TX_USECS |
+				     ETHTOOL_COALESCE_TX_MAX_FRAMES,
+#endif
 	.get_drvinfo = onic_get_drvinfo,
 	.get_link = ethtool_op_get_link,
+	.get_coalesce = onic_get_coalesce,
+	.set_coalesce = onic_set_coalesce,
+	.get_sset_count = onic_get_sset_count,
+	.get_strings = onic_get_strings,
+	.get_priv_flags = onic_get_priv_flags,
+	.set_priv_flags = onic_set_priv_flags,
 };
 
 void onic_set_ethtool_ops(struct net_device *netdev)
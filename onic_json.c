@@ -123,6 +123,50 @@ int onic_get_platform_info(char *fname, struct onic_platform_info *pinfo)
 				(parsingBuffer[0] != 'f') && (parsingBuffer[0]
 							      != 'F');
 			i++;
+		} else if (jsoneq(jsonBuffer, &tokens[i], "poll_color")) {
+			snprintf(parsingBuffer, PARSEBUF_LEN, "%.*s",
+				 tokens[i+1].end - tokens[i+1].start, jsonBuffer
+				 + tokens[i+1].start);
+			pinfo->poll_color = (parsingBuffer[0] != '0') &&
+				(parsingBuffer[0] != 'f') && (parsingBuffer[0]
+							      != 'F');
+			i++;
+		} else if (jsoneq(jsonBuffer, &tokens[i], "indirect_intr")) {
+			snprintf(parsingBuffer, PARSEBUF_LEN, "%.*s",
+				 tokens[i+1].end - tokens[i+1].start, jsonBuffer
+				 + tokens[i+1].start);
+			pinfo->indirect_intr = (parsingBuffer[0] != '0') &&
+				(parsingBuffer[0] != 'f') && (parsingBuffer[0]
+							      != 'F');
+			i++;
+		} else if (jsoneq(jsonBuffer, &tokens[i], "poll_spin_us")) {
+			snprintf(parsingBuffer, PARSEBUF_LEN, "%.*s",
+				 tokens[i+1].end - tokens[i+1].start, jsonBuffer
+				 + tokens[i+1].start);
+			kstrtoint(parsingBuffer, 10, &pinfo->poll_spin_us);
+			i++;
+		} else if (jsoneq(jsonBuffer, &tokens[i], "intr_ring_sz")) {
+			snprintf(parsingBuffer, PARSEBUF_LEN, "%.*s",
+				 tokens[i+1].end - tokens[i+1].start, jsonBuffer
+				 + tokens[i+1].start);
+			kstrtoint(parsingBuffer, 10, &pinfo->intr_ring_sz);
+			i++;
+		} else if (jsoneq(jsonBuffer, &tokens[i], "irq_affinity")) {
+			snprintf(parsingBuffer, PARSEBUF_LEN, "%.*s",
+				 tokens[i+1].end - tokens[i+1].start, jsonBuffer
+				 + tokens[i+1].start);
+			pinfo->irq_affinity = (parsingBuffer[0] != '0') &&
+				(parsingBuffer[0] != 'f') && (parsingBuffer[0]
+							      != 'F');
+			i++;
+		} else if (jsoneq(jsonBuffer, &tokens[i], "wq_unbound")) {
+			snprintf(parsingBuffer, PARSEBUF_LEN, "%.*s",
+				 tokens[i+1].end - tokens[i+1].start, jsonBuffer
+				 + tokens[i+1].start);
+			pinfo->wq_unbound = (parsingBuffer[0] != '0') &&
+				(parsingBuffer[0] != 'f') && (parsingBuffer[0]
+							      != 'F');
+			i++;
 		} else if (jsoneq(jsonBuffer, &tokens[i], "intr_mod_en")) {
 			snprintf(parsingBuffer, PARSEBUF_LEN, "%.*s",
 				 tokens[i+1].end - tokens[i+1].start, jsonBuffer
@@ -155,6 +199,26 @@ int onic_get_platform_info(char *fname, struct onic_platform_info *pinfo)
 				 + tokens[i+1].start);
 			kstrtoint(parsingBuffer, 10, &pinfo->c2h_buf_sz);
 			i++;
+		} else if (jsoneq(jsonBuffer, &tokens[i], "c2h_buf_sz_small")) {
+			snprintf(parsingBuffer, PARSEBUF_LEN, "%.*s",
+				 tokens[i+1].end - tokens[i+1].start, jsonBuffer
+				 + tokens[i+1].start);
+			kstrtoint(parsingBuffer, 10, &pinfo->c2h_buf_sz_small);
+			i++;
+		} else if (jsoneq(jsonBuffer, &tokens[i], "small_buf_queues")) {
+			snprintf(parsingBuffer, PARSEBUF_LEN, "%.*s",
+				 tokens[i+1].end - tokens[i+1].start, jsonBuffer
+				 + tokens[i+1].start);
+			kstrtou16(parsingBuffer, 10, &pinfo->small_buf_queues);
+			i++;
+		} else if (jsoneq(jsonBuffer, &tokens[i], "rx_hash_en")) {
+			snprintf(parsingBuffer, PARSEBUF_LEN, "%.*s",
+				 tokens[i+1].end - tokens[i+1].start, jsonBuffer
+				 + tokens[i+1].start);
+			pinfo->rx_hash_en = (parsingBuffer[0] != '0') &&
+				(parsingBuffer[0] != 'f') && (parsingBuffer[0]
+							      != 'F');
+			i++;
 		} else if (jsoneq(jsonBuffer, &tokens[i], "rsfec_en")) {
 			snprintf(parsingBuffer, PARSEBUF_LEN, "%.*s",
 				 tokens[i+1].end - tokens[i+1].start, jsonBuffer
@@ -10,11 +10,20 @@ struct onic_platform_info {
 	u8 pci_msix_user_cnt;
 	bool pci_master_pf;
 	bool poll_mode;
+	bool poll_color;
+	int poll_spin_us;
+	bool indirect_intr;
+	int intr_ring_sz;
+	bool irq_affinity;
+	bool wq_unbound;
 	bool intr_mod_en;
 	int ring_sz;
 	int c2h_tmr_cnt;
 	int c2h_cnt_thr;
 	int c2h_buf_sz;
+	int c2h_buf_sz_small;
+	u16 small_buf_queues;
+	bool rx_hash_en;
 	bool rsfec_en;
 	u8 port_id;
 	u8 mac_addr[6];
@@ -5,6 +5,8 @@
 #include <linux/pci.h>
 #include <linux/etherdevice.h>
 #include <linux/netdevice.h>
+#include <linux/interrupt.h>
+#include <linux/version.h>
 #include <net/busy_poll.h>
 
 #include "onic.h"
@@ -53,6 +55,47 @@ static int onic_stats_alloc(struct onic_priv *xpriv)
 	return 0;
 }
 
+static void onic_stats_free(struct onic_priv *xpriv)
+{
+	kfree(xpriv->tx_qstats);
+	xpriv->tx_qstats = NULL;
+	xpriv->rx_qstats = NULL;
+}
+
+/* This function returns the memory footprint of a single rx buffer of the
+ * queue. libqdma carves the freelist pages in power of 2 slices
+ */
+static unsigned int onic_rx_buf_truesize(struct onic_priv *xpriv, u32 q_no)
+{
+	u8 idx = xpriv->rx_buf_sz_idx;
+
+	if (q_no < xpriv->pinfo->small_buf_queues)
+		idx = xpriv->rx_small_buf_sz_idx;
+
+	return roundup_pow_of_two(xpriv->csr_conf.c2h_buf_sz[idx]);
+}
+
+/* This function sets the rss hash carried in the completion entry udd */
+static void onic_rx_hash(struct sk_buff *skb, const void *udd)
+{
+	const __le32 *cmpl = udd;
+	u32 type = le32_to_cpu(cmpl[ONIC_CMPL_HASH_DW + 1]) &
+		   ONIC_CMPL_HASH_TYPE_MASK;
+
+	switch (type) {
+	case ONIC_CMPL_HASH_TYPE_L3:
+		skb_set_hash(skb, le32_to_cpu(cmpl[ONIC_CMPL_HASH_DW]),
+			     PKT_HASH_TYPE_L3);
+		break;
+	case ONIC_CMPL_HASH_TYPE_L4:
+		skb_set_hash(skb, le32_to_cpu(cmpl[ONIC_CMPL_HASH_DW]),
+			     PKT_HASH_TYPE_L4);
+		break;
+	default:
+		break;
+	}
+}
+
 /* This function creates skb and moves data from dma request to network domain */
 static int onic_rx_deliver(struct onic_priv *xpriv, u32 q_no, unsigned int len,
 			   unsigned int sgcnt, struct qdma_sw_sg *sgl, void *udd)
@@ -60,6 +103,8 @@ static int onic_rx_deliver(struct onic_priv *xpriv, u32 q_no, unsigned int len,
 	struct net_device *netdev = xpriv->netdev;
 	struct sk_buff *skb = NULL;
 	struct qdma_sw_sg *c2h_sgl = sgl;
+	unsigned int buf_truesize;
+	bool copy;
 
 	if (!sgcnt) {
 		netdev_err(netdev, "%s: SG Count is NULL\n", __func__);
@@ -70,7 +115,19 @@ static int onic_rx_deliver(struct onic_priv *xpriv, u32 q_no, unsigned int len,
 		return -EINVAL;
 	}
 
-	if (len <= ONIC_RX_COPY_THRES || !(netdev->features & NETIF_F_SG)) {
+	buf_truesize = onic_rx_buf_truesize(xpriv, q_no);
+	copy = (len <= ONIC_RX_COPY_THRES || !(netdev->features & NETIF_F_SG));
+	/* copy out and release the buffers rather than pinning mostly empty
+	 * slices in the socket receive queue
+	 */
+	if (!copy && (xpriv->priv_flags & ONIC_PRIV_FLAG_RX_COPY_LOW_UTIL) &&
+	    (len * 100 < sgcnt * buf_truesize * ONIC_RX_COPY_UTIL_PCT))
+		copy = true;
+
+	if (copy) {
+		unsigned int copied = 0;
+		unsigned int copy_len;
+
 		skb = napi_alloc_skb(&xpriv->napi[q_no], len);
 		if (unlikely(!skb)) {
 			netdev_err(netdev, "%s: napi_alloc_skb() failed\n",
@@ -78,10 +135,20 @@ static int onic_rx_deliver(struct onic_priv *xpriv, u32 q_no, unsigned int len,
 			return -ENOMEM;
 		}
 
-		skb_copy_to_linear_data(skb, page_address(c2h_sgl->pg) +
-					c2h_sgl->offset, len);
+		/* packet may span several buffers of a small buffer queue */
+		while (sgcnt && c2h_sgl) {
+			copy_len = min(len - copied, c2h_sgl->len);
+			skb_copy_to_linear_data_offset(skb, copied,
+						       page_address(c2h_sgl->pg) +
+						       c2h_sgl->offset,
+						       copy_len);
+			copied += copy_len;
+			put_page(c2h_sgl->pg);
+
+			sgcnt--;
+			c2h_sgl = c2h_sgl->next;
+		}
 		__skb_put(skb, len);
-		put_page(c2h_sgl->pg);
 	} else {
 		unsigned int nr_frags = 0;
 		unsigned int frag_len;
@@ -118,11 +185,14 @@ static int onic_rx_deliver(struct onic_priv *xpriv, u32 q_no, unsigned int len,
 
 		skb->len = len;
 		skb->data_len = len - ONIC_RX_PULL_LEN;
-		skb->truesize += skb->data_len;
+		/* every frag pins a whole buffer slice of the freelist page */
+		skb->truesize += nr_frags * buf_truesize;
 	}
 
 	skb->protocol = eth_type_trans(skb, netdev);
 	skb->ip_summed = CHECKSUM_NONE;
+	if (udd && (netdev->features & NETIF_F_RXHASH))
+		onic_rx_hash(skb, udd);
 	skb_record_rx_queue(skb, q_no);
 
 	skb_mark_napi_id(skb, &xpriv->napi[q_no]);
@@ -177,6 +247,204 @@ static int onic_rx_pkt_process(unsigned long qhndl, unsigned long quld,
 	return ret;
 }
 
+/* This function returns the index of the global CSR entry closest to value */
+u8 onic_csr_closest_idx(unsigned int *arr, unsigned int value)
+{
+	unsigned int diff, best_diff = UINT_MAX;
+	u8 i, best = 0;
+
+	for (i = 0; i < QDMA_GLOBAL_CSR_ARRAY_SZ; i++) {
+		diff = (arr[i] > value) ? (arr[i] - value) : (value - arr[i]);
+		if (diff < best_diff) {
+			best_diff = diff;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+/* This function takes a reference on the timer or counter threshold slot
+ * closest to value. The CSR values are read again first, another function
+ * of the card may have reprogrammed a free slot since the last read.
+ */
+int onic_csr_closest_slot_get(struct onic_priv *xpriv,
+			      enum qdma_global_csr_type type,
+			      unsigned int value, u8 *idx)
+{
+	struct global_csr_conf csr;
+	unsigned int *arr;
+	int ret;
+
+	ret = qdma_global_csr_get(xpriv->dev_handle, 0,
+				  QDMA_GLOBAL_CSR_ARRAY_SZ, &csr);
+	if (ret < 0)
+		return ret;
+
+	arr = (type == QDMA_CSR_TIMER_CNT) ? csr.c2h_timer_cnt :
+					     csr.c2h_cnt_th;
+
+	/* a slot holding the value is referenced, not reprogrammed */
+	return qdma_global_csr_slot_get(xpriv->dev_handle, type,
+					arr[onic_csr_closest_idx(arr, value)],
+					idx);
+}
+
+/* This function drops the references on the global CSR slots selected by
+ * net_dim for an Rx queue. The queue must no longer use them.
+ */
+void onic_rx_dim_slots_put(struct onic_priv *xpriv, u16 q_no)
+{
+	struct onic_dim *rx_dim = &xpriv->rx_dim[q_no];
+
+	if (test_bit(ONIC_CSR_REF_TIMER, &rx_dim->csr_refs))
+		qdma_global_csr_slot_put(xpriv->dev_handle, QDMA_CSR_TIMER_CNT,
+					 rx_dim->timer_idx);
+	if (test_bit(ONIC_CSR_REF_CNT_TH, &rx_dim->csr_refs))
+		qdma_global_csr_slot_put(xpriv->dev_handle, QDMA_CSR_CNT_TH,
+					 rx_dim->cnt_th_idx);
+	rx_dim->csr_refs = 0;
+}
+
+/* This function programs the completion timer and counter threshold indexes
+ * of a running Rx queue
+ */
+int onic_set_rx_cmpl_ctrl(struct onic_priv *xpriv, u16 q_no, u8 timer_idx,
+			  u8 cnt_th_idx)
+{
+	struct qdma_cmpl_ctrl cctrl;
+	int ret;
+
+	memset(&cctrl, 0, sizeof(struct qdma_cmpl_ctrl));
+	cctrl.timer_idx = timer_idx;
+	cctrl.cnt_th_idx = cnt_th_idx;
+	cctrl.trigger_mode = xpriv->rx_trig_mode;
+	cctrl.en_stat_desc = !(xpriv->pinfo->poll_mode &&
+				xpriv->pinfo->poll_color);
+	cctrl.cmpl_en_intr = (xpriv->pinfo->poll_mode == 0);
+
+	ret = qdma_queue_cmpl_ctrl(xpriv->dev_handle,
+				   xpriv->base_rx_q_handle + q_no, &cctrl, true);
+	if (ret != 0)
+		netdev_err(xpriv->netdev,
+			   "%s: qdma_queue_cmpl_ctrl() failed for queue %d with status %d\n",
+			   __func__, q_no, ret);
+
+	return ret;
+}
+
+/* This function sets the Tx completion interrupt moderation of a running
+ * Tx queue
+ */
+int onic_set_tx_irq_moder(struct onic_priv *xpriv, u16 q_no, u16 frames,
+			  u16 usecs)
+{
+	int ret;
+
+	ret = qdma_queue_h2c_irq_moder(xpriv->dev_handle,
+				       xpriv->base_tx_q_handle + q_no,
+				       frames, usecs);
+	if (ret != 0)
+		netdev_err(xpriv->netdev,
+			   "%s: qdma_queue_h2c_irq_moder() failed for queue %d with status %d\n",
+			   __func__, q_no, ret);
+
+	return ret;
+}
+
+/* This is the net_dim work for Rx queue. It maps the selected profile onto
+ * the closest global CSR timer and counter threshold entries. The queue
+ * holds a reference on both slots so no other function reprograms them,
+ * the previous slots are released once the queue moved off them.
+ */
+static void onic_rx_dim_work(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct onic_dim *rx_dim = container_of(dim, struct onic_dim, dim);
+	struct onic_priv *xpriv = rx_dim->xpriv;
+	unsigned long old_refs = rx_dim->csr_refs;
+	u8 old_timer_idx = rx_dim->timer_idx;
+	u8 old_cnt_th_idx = rx_dim->cnt_th_idx;
+	struct dim_cq_moder moder;
+	u8 timer_idx, cnt_th_idx;
+
+	if (!xpriv->adaptive_rx) {
+		dim->state = DIM_START_MEASURE;
+		return;
+	}
+
+	moder = net_dim_get_rx_moderation(dim->mode, dim->profile_ix);
+
+	if (onic_csr_closest_slot_get(xpriv, QDMA_CSR_TIMER_CNT, moder.usec,
+				      &timer_idx) < 0)
+		goto out;
+	if (onic_csr_closest_slot_get(xpriv, QDMA_CSR_CNT_TH, moder.pkts,
+				      &cnt_th_idx) < 0) {
+		qdma_global_csr_slot_put(xpriv->dev_handle, QDMA_CSR_TIMER_CNT,
+					 timer_idx);
+		goto out;
+	}
+
+	rx_dim->timer_idx = timer_idx;
+	rx_dim->cnt_th_idx = cnt_th_idx;
+	rx_dim->csr_refs = BIT(ONIC_CSR_REF_TIMER) | BIT(ONIC_CSR_REF_CNT_TH);
+	onic_set_rx_cmpl_ctrl(xpriv, rx_dim->q_no, timer_idx, cnt_th_idx);
+
+	if (test_bit(ONIC_CSR_REF_TIMER, &old_refs))
+		qdma_global_csr_slot_put(xpriv->dev_handle, QDMA_CSR_TIMER_CNT,
+					 old_timer_idx);
+	if (test_bit(ONIC_CSR_REF_CNT_TH, &old_refs))
+		qdma_global_csr_slot_put(xpriv->dev_handle, QDMA_CSR_CNT_TH,
+					 old_cnt_th_idx);
+out:
+	dim->state = DIM_START_MEASURE;
+}
+
+/* This function feeds the Rx queue statistics of a finished poll to net_dim */
+static void onic_rx_dim_update(struct onic_priv *xpriv, int q_no)
+{
+	struct onic_dim *rx_dim = &xpriv->rx_dim[q_no];
+	struct dim_sample sample = {};
+
+	rx_dim->event_ctr++;
+	dim_update_sample(rx_dim->event_ctr, xpriv->rx_qstats[q_no].rx_packets,
+			  xpriv->rx_qstats[q_no].rx_bytes, &sample);
+	net_dim(&rx_dim->dim, sample);
+}
+
+/* This is the net_dim work for Tx queue. The interrupt is armed every
+ * profile frames, the timer covers the rest
+ */
+static void onic_tx_dim_work(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct onic_dim *tx_dim = container_of(dim, struct onic_dim, dim);
+	struct onic_priv *xpriv = tx_dim->xpriv;
+	struct dim_cq_moder moder;
+
+	if (!xpriv->adaptive_tx) {
+		dim->state = DIM_START_MEASURE;
+		return;
+	}
+
+	moder = net_dim_get_tx_moderation(dim->mode, dim->profile_ix);
+	onic_set_tx_irq_moder(xpriv, tx_dim->q_no, moder.pkts, moder.usec);
+
+	dim->state = DIM_START_MEASURE;
+}
+
+/* This function feeds the Tx queue statistics of a finished poll to net_dim */
+static void onic_tx_dim_update(struct onic_priv *xpriv, int q_no)
+{
+	struct onic_dim *tx_dim = &xpriv->tx_dim[q_no];
+	struct dim_sample sample = {};
+
+	tx_dim->event_ctr++;
+	dim_update_sample(tx_dim->event_ctr, xpriv->tx_qstats[q_no].tx_packets,
+			  xpriv->tx_qstats[q_no].tx_bytes, &sample);
+	net_dim(&tx_dim->dim, sample);
+}
+
 /* This is deffered NAPI task for processing incoming Rx packet from DMA queue
  * This function will from sk_buff from Rx queue data and
  * pass it to above networking layers for processing
@@ -184,8 +452,7 @@ static int onic_rx_pkt_process(unsigned long qhndl, unsigned long quld,
 static int onic_rx_poll(struct napi_struct *napi, int quota)
 {
 	int queue_id;
-	unsigned long q_handle;
-	unsigned int udd_cnt = 0, pkt_cnt = 0, data_len = 0;
+	struct qdma_c2h_service_stat stat;
 	struct onic_priv *xpriv;
 	struct net_device *netdev;
 	int ret;
@@ -208,28 +475,46 @@ static int onic_rx_poll(struct napi_struct *napi, int quota)
 	}
 
 	queue_id = (int)(napi - xpriv->napi);
-	q_handle = (xpriv->base_rx_q_handle + queue_id);
 
-	/* Call queue service for QDMA Core to service queue */
-	ret = qdma_queue_service(xpriv->dev_handle, q_handle, quota, true);
-	/* Indicate napi_complete irrespective of ret */
-	napi_complete(napi);
+	/* Reap the Tx completions of the queue pair first, their interrupt
+	 * schedules this NAPI context as well
+	 */
+	if (!xpriv->pinfo->poll_mode &&
+	    queue_id < netdev->real_num_tx_queues) {
+		qdma_queue_service_fp(xpriv->tx_q_fp[queue_id], 0, true);
+		onic_tx_maybe_wake(xpriv, queue_id);
+		if (xpriv->adaptive_tx)
+			onic_tx_dim_update(xpriv, queue_id);
+	}
+
+	/* Service the completion ring, refill and update the pointers in one
+	 * pass. The completion interrupt is left masked
+	 */
+	ret = qdma_queue_c2h_service_fp(xpriv->rx_q_fp[queue_id], quota,
+					&stat);
 	if (!xpriv->pinfo->poll_mode && ret < 0) {
-		netdev_dbg(netdev, "%s: qdma_queue_service for queue=%d returned status=%d\n",
+		netdev_dbg(netdev, "%s: qdma_queue_c2h_service for queue=%d returned status=%d\n",
 			   __func__, queue_id, ret);
-		return ret;
+		/* Give up the queue, never hand an error to NAPI */
+		napi_complete(napi);
+		return 0;
 	}
 
-	if (xpriv->qdma_dev_conf.intr_moderation)
-		qdma_queue_c2h_peek(xpriv->dev_handle, q_handle, &udd_cnt,
-				    &pkt_cnt, &data_len);
-
-	qdma_queue_update_pointers(xpriv->dev_handle, q_handle);
+	/* Stay scheduled while the budget is used up, or always in poll mode */
+	if (xpriv->pinfo->poll_mode || !stat.irq_arm)
+		return quota;
 
-	if (xpriv->pinfo->poll_mode || (pkt_cnt >= quota))
-		napi_reschedule(napi);
+	/* Complete NAPI and re-arm outside of the Rx queue lock. The interrupt
+	 * is left masked when busy polling or deferred hard irqs still own the
+	 * queue
+	 */
+	if (napi_complete_done(napi, stat.processed)) {
+		qdma_queue_c2h_irq_arm_fp(xpriv->rx_q_fp[queue_id]);
+		if (xpriv->adaptive_rx)
+			onic_rx_dim_update(xpriv, queue_id);
+	}
 
-	return 0;
+	return stat.processed;
 }
 
 /* This function is RX interrupt handler (TOP half) */
@@ -262,14 +547,25 @@ static int onic_qdma_rx_queue_add(struct onic_priv *xpriv, u32 q_no,
 	qconf.irq_en = 0;
 	qconf.pfetch_en = 1;
 	qconf.fetch_credit = 1;
-	qconf.cmpl_stat_en = 1;
-	qconf.cmpl_desc_sz = DESC_SZ_8B;
+	/* in poll mode, new entries can be found by their colour bit */
+	qconf.cmpl_stat_en = !(xpriv->pinfo->poll_mode &&
+			       xpriv->pinfo->poll_color);
+	if (xpriv->pinfo->rx_hash_en) {
+		/* the rss hash is carried in the completion udd */
+		qconf.cmpl_desc_sz = DESC_SZ_16B;
+		qconf.cmpl_udd_en = 1;
+	} else {
+		qconf.cmpl_desc_sz = DESC_SZ_8B;
+	}
 	qconf.cmpl_rng_sz_idx = xpriv->cmpl_rng_sz_idx;
 	qconf.desc_rng_sz_idx = xpriv->rx_desc_rng_sz_idx;
-	qconf.c2h_buf_sz_idx = xpriv->rx_buf_sz_idx;
+	if (q_no < xpriv->pinfo->small_buf_queues)
+		qconf.c2h_buf_sz_idx = xpriv->rx_small_buf_sz_idx;
+	else
+		qconf.c2h_buf_sz_idx = xpriv->rx_buf_sz_idx;
 	qconf.cmpl_timer_idx = timer_idx;
 	qconf.cmpl_cnt_th_idx = cnt_th_idx;
-	qconf.cmpl_trig_mode = TRIG_MODE_COMBO;
+	qconf.cmpl_trig_mode = xpriv->rx_trig_mode;
 	qconf.cmpl_en_intr = (xpriv->pinfo->poll_mode == 0);
 	qconf.quld = (unsigned long)xpriv;
 	qconf.fp_descq_isr_top = onic_isr_rx_tophalf;
@@ -295,6 +591,13 @@ static int onic_qdma_rx_queue_add(struct onic_priv *xpriv, u32 q_no,
 	if (q_no == 0)
 		xpriv->base_rx_q_handle = q_handle;
 
+	xpriv->rx_q_fp[q_no] = qdma_queue_fp_hndl(xpriv->dev_handle, q_handle);
+	if (!xpriv->rx_q_fp[q_no]) {
+		qdma_queue_remove(xpriv->dev_handle, q_handle, error_str,
+				  ONIC_ERROR_STR_BUF_LEN);
+		return -EINVAL;
+	}
+
 	return 0;
 }
 
@@ -314,9 +617,15 @@ static void onic_qdma_rx_queue_release(struct onic_priv *xpriv, int num_queues)
 				   __func__, q_no, ret, error_str);
 		}
 		netif_napi_del(&xpriv->napi[q_no]);
+		onic_rx_dim_slots_put(xpriv, q_no);
 	}
 
+	kfree(xpriv->rx_q_fp);
+	xpriv->rx_q_fp = NULL;
+	kfree(xpriv->rx_dim);
+	xpriv->rx_dim = NULL;
 	kfree(xpriv->napi);
+	xpriv->napi = NULL;
 }
 
 /* This function sets up RX queues */
@@ -329,6 +638,22 @@ static int onic_qdma_rx_queue_setup(struct onic_priv *xpriv)
 	if (!xpriv->napi) 
 		return -ENOMEM;
 
+	xpriv->rx_dim = kcalloc(xpriv->netdev->real_num_rx_queues,
+				sizeof(struct onic_dim), GFP_KERNEL);
+	xpriv->rx_q_fp = kcalloc(xpriv->netdev->real_num_rx_queues,
+				 sizeof(struct qdma_descq *), GFP_KERNEL);
+	if (!xpriv->rx_dim || !xpriv->rx_q_fp) {
+		onic_qdma_rx_queue_release(xpriv, 0);
+		return -ENOMEM;
+	}
+
+	for (q_no = 0; q_no < xpriv->netdev->real_num_rx_queues; q_no++) {
+		xpriv->rx_dim[q_no].xpriv = xpriv;
+		xpriv->rx_dim[q_no].q_no = q_no;
+		xpriv->rx_dim[q_no].dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+		INIT_WORK(&xpriv->rx_dim[q_no].dim.work, onic_rx_dim_work);
+	}
+
 	for (q_no = 0; q_no < xpriv->netdev->real_num_rx_queues; q_no++) {
 		ret = onic_qdma_rx_queue_add(xpriv, q_no, xpriv->rx_timer_idx,
 					     xpriv->rx_cnt_th_idx);
@@ -357,14 +682,13 @@ static void onic_isr_tx_tophalf(unsigned long qhndl, unsigned long uld)
 {
 	u32 q_no;
 	struct onic_priv *xpriv = (struct onic_priv *)uld;
-	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)xpriv->dev_handle;
-	struct qdma_descq *descq = qdma_device_get_descq_by_id(xdev, qhndl,
-							       NULL, 0, 0);
-
-	schedule_work(&descq->work);
 
-	/* If ISR is for Tx queue */
+	/* If ISR is for Tx queue. Tx completions are reaped by the NAPI
+	 * context of the queue pair, straight from the hard irq
+	 */
 	q_no = (qhndl - xpriv->base_tx_q_handle);
+	napi_schedule_irqoff(&xpriv->napi[q_no]);
+
 	netdev_dbg(xpriv->netdev, "%s: Tx interrupt called, Mapped queue no = %d\n",
 		   __func__, q_no);
 }
@@ -386,6 +710,11 @@ static void onic_qdma_tx_queue_release(struct onic_priv *xpriv, int num_queues)
 		}
 
 	}
+
+	kfree(xpriv->tx_q_fp);
+	xpriv->tx_q_fp = NULL;
+	kfree(xpriv->tx_dim);
+	xpriv->tx_dim = NULL;
 }
 
 /* This function sets up Tx queues */
@@ -396,6 +725,22 @@ static int onic_qdma_tx_queue_setup(struct onic_priv *xpriv)
 	unsigned long q_handle = 0;
 	struct qdma_queue_conf qconf;
 
+	xpriv->tx_dim = kcalloc(xpriv->netdev->real_num_tx_queues,
+				sizeof(struct onic_dim), GFP_KERNEL);
+	xpriv->tx_q_fp = kcalloc(xpriv->netdev->real_num_tx_queues,
+				 sizeof(struct qdma_descq *), GFP_KERNEL);
+	if (!xpriv->tx_dim || !xpriv->tx_q_fp) {
+		onic_qdma_tx_queue_release(xpriv, 0);
+		return -ENOMEM;
+	}
+
+	for (q_no = 0; q_no < xpriv->netdev->real_num_tx_queues; q_no++) {
+		xpriv->tx_dim[q_no].xpriv = xpriv;
+		xpriv->tx_dim[q_no].q_no = q_no;
+		xpriv->tx_dim[q_no].dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+		INIT_WORK(&xpriv->tx_dim[q_no].dim.work, onic_tx_dim_work);
+	}
+
 	for (q_no = 0; q_no < xpriv->netdev->real_num_tx_queues; q_no++) {
 		memset(&qconf, 0, sizeof(struct qdma_queue_conf));
 		qconf.st = 1;
@@ -406,6 +751,7 @@ static int onic_qdma_tx_queue_setup(struct onic_priv *xpriv)
 		qconf.cmpl_status_acc_en = 1;
 		qconf.cmpl_status_pend_chk = 1;
 		qconf.desc_rng_sz_idx = xpriv->tx_desc_rng_sz_idx;
+		qconf.pidx_acc = xpriv->tx_pidx_acc;
 		qconf.fp_descq_isr_top = onic_isr_tx_tophalf;
 		qconf.quld = (unsigned long)xpriv;
 		qconf.qidx = q_no;
@@ -422,6 +768,14 @@ static int onic_qdma_tx_queue_setup(struct onic_priv *xpriv)
 		if (q_no == 0)
 			xpriv->base_tx_q_handle = q_handle;
 
+		xpriv->tx_q_fp[q_no] = qdma_queue_fp_hndl(xpriv->dev_handle,
+							  q_handle);
+		if (!xpriv->tx_q_fp[q_no]) {
+			qdma_queue_remove(xpriv->dev_handle, q_handle,
+					  error_str, ONIC_ERROR_STR_BUF_LEN);
+			ret = -EINVAL;
+			goto cleanup_tx_q;
+		}
 	}
 	return 0;
 
@@ -501,6 +855,133 @@ static int onic_qdma_start(struct onic_priv *xpriv)
 	return 0;
 }
 
+static void onic_irq_aff_notify(struct irq_affinity_notify *notify,
+				const cpumask_t *mask)
+{
+	struct onic_irq_aff *aff = container_of(notify, struct onic_irq_aff,
+						notify);
+	struct onic_priv *xpriv = aff->xpriv;
+	u16 q_no;
+
+	/* keep tx of the queue pairs on the cpus taking their interrupt, the
+	 * notifier sits on the first queue pair of the vector
+	 */
+	for (q_no = aff->q_no; q_no < xpriv->netdev->real_num_tx_queues; q_no++)
+		if (xpriv->irq_aff[q_no].irq == aff->irq)
+			netif_set_xps_queue(xpriv->netdev, mask, q_no);
+}
+
+/* the context lives in xpriv->irq_aff, nothing to release */
+static void onic_irq_aff_release(struct kref *ref)
+{
+}
+
+static void onic_irq_set_hint(int irq, const struct cpumask *mask)
+{
+#if KERNEL_VERSION(5, 17, 0) <= LINUX_VERSION_CODE
+	if (mask)
+		irq_set_affinity_and_hint(irq, mask);
+	else
+		irq_update_affinity_hint(irq, NULL);
+#else
+	irq_set_affinity_hint(irq, mask);
+#endif
+}
+
+/* This function returns the first queue pair whose rx queue takes irq */
+static u16 onic_irq_aff_owner(struct onic_priv *xpriv, int irq)
+{
+	u16 q_no;
+
+	for (q_no = 0; q_no < xpriv->netdev->real_num_rx_queues; q_no++)
+		if (xpriv->irq_aff[q_no].irq == irq)
+			break;
+
+	return q_no;
+}
+
+/* This function spreads the data vectors over the cores of the local NUMA
+ * node and sets a matching XPS map. In indirect interrupt mode the queue
+ * pairs sharing a vector follow the first of them.
+ */
+static void onic_set_irq_affinity(struct onic_priv *xpriv)
+{
+	struct net_device *netdev = xpriv->netdev;
+	int node = dev_to_node(&xpriv->pcidev->dev);
+	struct onic_irq_aff *aff;
+	u16 q_no, owner;
+	int nb_vecs = 0;
+
+	xpriv->irq_aff = kcalloc(netdev->real_num_rx_queues,
+				 sizeof(struct onic_irq_aff), GFP_KERNEL);
+	if (!xpriv->irq_aff)
+		return;
+
+	for (q_no = 0; q_no < netdev->real_num_rx_queues; q_no++) {
+		aff = &xpriv->irq_aff[q_no];
+		aff->xpriv = xpriv;
+		aff->q_no = q_no;
+		aff->irq = qdma_queue_get_irq(xpriv->dev_handle,
+					      xpriv->base_rx_q_handle + q_no);
+		aff->tx_irq = -EINVAL;
+		if (q_no < netdev->real_num_tx_queues)
+			aff->tx_irq = qdma_queue_get_irq(xpriv->dev_handle,
+						xpriv->base_tx_q_handle + q_no);
+	}
+
+	for (q_no = 0; q_no < netdev->real_num_rx_queues; q_no++) {
+		aff = &xpriv->irq_aff[q_no];
+		owner = aff->irq >= 0 ? onic_irq_aff_owner(xpriv, aff->irq) :
+					q_no;
+		if (owner != q_no) {
+			aff->cpu = xpriv->irq_aff[owner].cpu;
+		} else if (aff->irq >= 0) {
+			aff->cpu = cpumask_local_spread(nb_vecs++, node);
+			onic_irq_set_hint(aff->irq, cpumask_of(aff->cpu));
+			aff->notify.notify = onic_irq_aff_notify;
+			aff->notify.release = onic_irq_aff_release;
+			if (irq_set_affinity_notifier(aff->irq, &aff->notify))
+				netdev_warn(netdev, "%s: no affinity notifier for queue %d\n",
+					    __func__, q_no);
+		} else {
+			aff->cpu = cpumask_local_spread(q_no, node);
+		}
+
+		/* a tx vector without rx queue follows its queue pair */
+		if (aff->tx_irq >= 0 &&
+		    onic_irq_aff_owner(xpriv, aff->tx_irq) ==
+		    netdev->real_num_rx_queues)
+			onic_irq_set_hint(aff->tx_irq, cpumask_of(aff->cpu));
+		if (q_no < netdev->real_num_tx_queues)
+			netif_set_xps_queue(netdev, cpumask_of(aff->cpu), q_no);
+	}
+}
+
+static void onic_clear_irq_affinity(struct onic_priv *xpriv)
+{
+	struct onic_irq_aff *aff;
+	u16 q_no;
+
+	if (!xpriv->irq_aff)
+		return;
+
+	for (q_no = 0; q_no < xpriv->netdev->real_num_rx_queues; q_no++) {
+		aff = &xpriv->irq_aff[q_no];
+		if (aff->irq >= 0 &&
+		    onic_irq_aff_owner(xpriv, aff->irq) == q_no) {
+			irq_set_affinity_notifier(aff->irq, NULL);
+			onic_irq_set_hint(aff->irq, NULL);
+		}
+		if (aff->tx_irq >= 0 &&
+		    onic_irq_aff_owner(xpriv, aff->tx_irq) ==
+		    xpriv->netdev->real_num_rx_queues)
+			onic_irq_set_hint(aff->tx_irq, NULL);
+	}
+
+	kfree(xpriv->irq_aff);
+	xpriv->irq_aff = NULL;
+}
+
 /* This function gets called when interface gets 'UP' request via 'ifconfig up'
  * In this function, Rx and Tx queues are setup and send/receive operations
  * are started
@@ -533,7 +1014,7 @@ int onic_open(struct net_device *netdev)
 	if (ret != 0) {
 		netdev_err(netdev, "%s: onic_qdmx_rx_queue_setup() failed with status %d\n",
 			   __func__, ret);
-		kfree(xpriv->tx_qstats);
+		onic_stats_free(xpriv);
 		return ret;
 	}
 
@@ -551,6 +1032,15 @@ int onic_open(struct net_device *netdev)
 		goto release_queues;
 	}
 
+	/* the Tx interrupt moderation starts from the static settings */
+	if (!xpriv->pinfo->poll_mode && xpriv->tx_frames > 1)
+		for (q_no = 0; q_no < netdev->real_num_tx_queues; q_no++)
+			onic_set_tx_irq_moder(xpriv, q_no, xpriv->tx_frames,
+					      xpriv->tx_usecs);
+
+	if (xpriv->pinfo->irq_affinity && !xpriv->pinfo->poll_mode)
+		onic_set_irq_affinity(xpriv);
+
 	for (q_no = 0; q_no < xpriv->netdev->real_num_rx_queues; q_no++)
 		napi_enable(&xpriv->napi[q_no]);
 
@@ -569,13 +1059,14 @@ release_queues:
 	onic_qdma_tx_queue_release(xpriv, xpriv->netdev->real_num_tx_queues);
 release_rx_queues:
 	onic_qdma_rx_queue_release(xpriv, xpriv->netdev->real_num_rx_queues);
+	onic_stats_free(xpriv);
 	return ret;
 }
 
 /* This function gets called when there is a interface down request.
  * In this function, Tx/Rx operations on the queues are stopped
  */
-static int onic_stop(struct net_device *netdev)
+int onic_stop(struct net_device *netdev)
 {
 	int ret = 0, q_no = 0;
 	struct onic_priv *xpriv;
@@ -594,8 +1085,18 @@ static int onic_stop(struct net_device *netdev)
 	netif_tx_stop_all_queues(netdev);
 	netif_carrier_off(netdev);
 
-	for (q_no = 0; q_no < xpriv->netdev->real_num_rx_queues; q_no++)
+	/* a failed reopen already released the queues */
+	if (!xpriv->napi)
+		return 0;
+
+	for (q_no = 0; q_no < xpriv->netdev->real_num_rx_queues; q_no++) {
 		napi_disable(&xpriv->napi[q_no]);
+		cancel_work_sync(&xpriv->rx_dim[q_no].dim.work);
+	}
+	for (q_no = 0; q_no < xpriv->netdev->real_num_tx_queues; q_no++)
+		cancel_work_sync(&xpriv->tx_dim[q_no].dim.work);
+
+	onic_clear_irq_affinity(xpriv);
 
 	ret = onic_qdma_stop(xpriv, netdev->real_num_tx_queues,
 			     netdev->real_num_rx_queues);
@@ -606,7 +1107,7 @@ static int onic_stop(struct net_device *netdev)
 	onic_qdma_rx_queue_release(xpriv, netdev->real_num_rx_queues);
 	onic_qdma_tx_queue_release(xpriv, netdev->real_num_tx_queues);
 
-	kfree(xpriv->tx_qstats);
+	onic_stats_free(xpriv);
 
 	netdev_info(netdev, "%s: device close done\n", __func__);
 	return ret;
@@ -678,6 +1179,38 @@ static int onic_unmap_free_pkt_data(struct qdma_request *req)
 	return 0;
 }
 
+/* This function wakes a Tx queue stopped on a full request ring once the
+ * ring drained. The barrier pairs with the one of onic_tx_maybe_stop().
+ */
+static void onic_tx_maybe_wake(struct onic_priv *xpriv, u16 q_id)
+{
+	struct netdev_queue *txq = netdev_get_tx_queue(xpriv->netdev, q_id);
+
+	smp_mb();
+	if (unlikely(netif_tx_queue_stopped(txq)) &&
+	    netif_carrier_ok(xpriv->netdev) &&
+	    qdma_queue_write_room_fp(xpriv->tx_q_fp[q_id]) >=
+	    ONIC_TX_WAKE_THRES)
+		netif_tx_wake_queue(txq);
+}
+
+/* This function stops a Tx queue whose request ring is full. The room is
+ * checked again after the stop in case the ring drained in between.
+ */
+static void onic_tx_maybe_stop(struct onic_priv *xpriv, u16 q_id)
+{
+	struct netdev_queue *txq = netdev_get_tx_queue(xpriv->netdev, q_id);
+
+	if (likely(qdma_queue_write_room_fp(xpriv->tx_q_fp[q_id]) > 0))
+		return;
+
+	netif_tx_stop_queue(txq);
+	smp_mb();
+	if (qdma_queue_write_room_fp(xpriv->tx_q_fp[q_id]) >=
+	    ONIC_TX_WAKE_THRES)
+		netif_tx_start_queue(txq);
+}
+
 /* This function is called by QDMA core when one or multiple packet
  * transmission is completed.
  * This function frees skb associated with the transmitted packets.
@@ -685,6 +1218,10 @@ static int onic_unmap_free_pkt_data(struct qdma_request *req)
 static int onic_tx_done(struct qdma_request *req, unsigned int bytes_done,
 			int err)
 {
+	struct onic_dma_request *onic_req =
+		(struct onic_dma_request *)req->uld_data;
+	struct onic_priv *xpriv = netdev_priv(onic_req->netdev);
+	u16 q_id = skb_get_queue_mapping(onic_req->skb);
 	int ret = 0;
 
 	ret = onic_unmap_free_pkt_data(req);
@@ -694,6 +1231,10 @@ static int onic_tx_done(struct qdma_request *req, unsigned int bytes_done,
 	pr_debug("%s: bytes_done = %d, error = %d\n",
 		 __func__, bytes_done, err);
 
+	/* poll mode has no NAPI Tx reap, the completions wake the queue */
+	if (xpriv->pinfo->poll_mode)
+		onic_tx_maybe_wake(xpriv, q_id);
+
 	return 0;
 }
 
@@ -702,7 +1243,6 @@ static int onic_start_xmit(struct sk_buff *skb, struct net_device *netdev)
 {
 	u16 q_id = 0, nb_frags = 0, frag_index = 0;
 	int ret = 0, count = 0;
-	unsigned long q_handle;
 	struct onic_priv *xpriv;
 	struct onic_dma_request *onic_req;
 	struct qdma_request *qdma_req;
@@ -744,7 +1284,13 @@ static int onic_start_xmit(struct sk_buff *skb, struct net_device *netdev)
 		return -EINVAL;
 	}
 
-	q_handle = xpriv->base_tx_q_handle + q_id;
+	/* the queue is stopped once the request ring fills up, see
+	 * onic_tx_maybe_stop()
+	 */
+	if (unlikely(qdma_queue_write_room_fp(xpriv->tx_q_fp[q_id]) <= 0)) {
+		netif_tx_stop_queue(netdev_get_tx_queue(netdev, q_id));
+		return NETDEV_TX_BUSY;
+	}
 
 	onic_req = kmem_cache_zalloc(xpriv->dma_req, GFP_ATOMIC);
 	if (unlikely(!onic_req)) {
@@ -806,11 +1352,12 @@ static int onic_start_xmit(struct sk_buff *skb, struct net_device *netdev)
 	qdma_req->fp_done = onic_tx_done;
 	qdma_req->uld_data = (unsigned long)onic_req;
 
-	count = qdma_queue_packet_write(xpriv->dev_handle, q_handle, qdma_req);
+	count = qdma_queue_packet_write_fp(xpriv->tx_q_fp[q_id], qdma_req);
 	if (unlikely(count < 0)) {
-		netdev_err(netdev,
-			   "%s: qdma_queue_packet_write() failed, err = %d\n",
-			   __func__, count);
+		if (net_ratelimit())
+			netdev_err(netdev,
+				   "%s: qdma_queue_packet_write() failed, err = %d\n",
+				   __func__, count);
 		ret = count;
 		goto free_packet_data;
 	}
@@ -818,6 +1365,8 @@ static int onic_start_xmit(struct sk_buff *skb, struct net_device *netdev)
 	xpriv->tx_qstats[q_id].tx_packets++;
 	xpriv->tx_qstats[q_id].tx_bytes += skb->len;
 
+	onic_tx_maybe_stop(xpriv, q_id);
+
 	return NETDEV_TX_OK;
 
 free_packet_data:
@@ -911,6 +1460,11 @@ static int onic_set_num_queue(struct onic_priv *xpriv)
 	nb_queues -= xpriv->pinfo->pci_msix_user_cnt;
 	if (xpriv->pinfo->pci_master_pf)
 		nb_queues--;
+	xpriv->nb_data_vecs = nb_queues;
+
+	/* queues share the data vectors through the interrupt rings */
+	if (xpriv->pinfo->indirect_intr && !xpriv->pinfo->poll_mode)
+		nb_queues = xpriv->pinfo->queue_max;
 
 	xpriv->num_msix = num_msix;
 	xpriv->nb_queues = nb_queues;
@@ -918,76 +1472,153 @@ static int onic_set_num_queue(struct onic_priv *xpriv)
 	return 0;
 }
 
-static int onic_arr_find(unsigned int *arr, int n, int element)
+/* This function takes a reference on a global CSR slot holding value,
+ * programming a free slot if none does, and refreshes the cached CSR values
+ */
+int onic_csr_slot_get(struct onic_priv *xpriv,
+		      enum qdma_global_csr_type type, unsigned int value,
+		      u8 *idx)
 {
-	int i = 0;
+	int ret;
 
-	for (i = 0; i < n; i++) {
-		if (*(arr + i) == element)
-			return i;
-	}
-	return -1;
+	ret = qdma_global_csr_slot_get(xpriv->dev_handle, type, value, idx);
+	if (ret < 0)
+		return ret;
+
+	qdma_global_csr_get(xpriv->dev_handle, 0, QDMA_GLOBAL_CSR_ARRAY_SZ,
+			    &xpriv->csr_conf);
+	return 0;
 }
 
-/* This function gets global CSR and sets the default indexes of the
- * xpriv structure. If the default value set in the driver doesn't match with
- * any of the values supported, index 0 is returned by default.
- */
-static int onic_qdma_csr_index_setup(struct onic_priv *xpriv)
+static int onic_csr_ref_get(struct onic_priv *xpriv, int ref,
+			    enum qdma_global_csr_type type, unsigned int value,
+			    u8 *idx)
 {
-	int ret = 0, index = 0;
-	struct global_csr_conf csr_conf;
+	int ret;
 
-	ret = qdma_global_csr_get(xpriv->dev_handle, 0,
-				  QDMA_GLOBAL_CSR_ARRAY_SZ, &csr_conf);
-	if (ret != 0) {
-		dev_err(&xpriv->pcidev->dev, 
-			"%s: qdma_global_csr_get() failed with status %d\n",
-			__func__, ret);
-		return -EINVAL;
+	ret = onic_csr_slot_get(xpriv, type, value, idx);
+	if (ret < 0) {
+		dev_err(&xpriv->pcidev->dev,
+			"%s: no global CSR %d slot for %u, err %d\n",
+			__func__, type, value, ret);
+		return ret;
 	}
+	set_bit(ref, &xpriv->csr_refs);
 
-	index = onic_arr_find(csr_conf.ring_sz, QDMA_GLOBAL_CSR_ARRAY_SZ,
-			      xpriv->pinfo->ring_sz);
-	if (index < 0) {
-		dev_err(&xpriv->pcidev->dev, 
-			"%s: Expected ring size %d not found\n", __func__, ret);
-		return index;
+	return 0;
+}
+
+/* This function drops the references on the global CSR slots held by the
+ * indexes of the xpriv structure
+ */
+void onic_csr_slots_release(struct onic_priv *xpriv)
+{
+	enum qdma_global_csr_type type;
+	int ref;
+	u8 idx;
+
+	for_each_set_bit(ref, &xpriv->csr_refs, ONIC_CSR_REF_MAX) {
+		switch (ref) {
+		case ONIC_CSR_REF_RING_SZ:
+			type = QDMA_CSR_RING_SZ;
+			idx = xpriv->tx_desc_rng_sz_idx;
+			break;
+		case ONIC_CSR_REF_TIMER:
+			type = QDMA_CSR_TIMER_CNT;
+			idx = xpriv->rx_timer_idx;
+			break;
+		case ONIC_CSR_REF_CNT_TH:
+			type = QDMA_CSR_CNT_TH;
+			idx = xpriv->rx_cnt_th_idx;
+			break;
+		case ONIC_CSR_REF_BUF_SZ:
+			type = QDMA_CSR_BUF_SZ;
+			idx = xpriv->rx_buf_sz_idx;
+			break;
+		default:
+			type = QDMA_CSR_BUF_SZ;
+			idx = xpriv->rx_small_buf_sz_idx;
+			break;
+		}
+		qdma_global_csr_slot_put(xpriv->dev_handle, type, idx);
 	}
+	xpriv->csr_refs = 0;
+}
+
+/* This function sets the default indexes of the xpriv structure. The global
+ * CSR slots are shared by all the functions of the card, a slot holding the
+ * configured value is referenced, or a free one is programmed with it.
+ */
+static int onic_qdma_csr_index_setup(struct onic_priv *xpriv)
+{
+	struct onic_platform_info *pinfo = xpriv->pinfo;
+	u8 index;
+	int ret;
+
+	ret = onic_csr_ref_get(xpriv, ONIC_CSR_REF_RING_SZ, QDMA_CSR_RING_SZ,
+			       pinfo->ring_sz, &index);
+	if (ret < 0)
+		goto release_slots;
 	xpriv->tx_desc_rng_sz_idx = index;
 	xpriv->rx_desc_rng_sz_idx = index;
 	xpriv->cmpl_rng_sz_idx = index;
 
-	index = onic_arr_find(csr_conf.c2h_timer_cnt, QDMA_GLOBAL_CSR_ARRAY_SZ,
-			      xpriv->pinfo->c2h_tmr_cnt);
-	if (index < 0) {
-		dev_err(&xpriv->pcidev->dev,
-			"%s: Expected default C2H Timer count %d not found\n",
-			__func__, xpriv->pinfo->c2h_tmr_cnt);
-		return index;
-	}
-	xpriv->rx_timer_idx = index;
+	ret = onic_csr_ref_get(xpriv, ONIC_CSR_REF_TIMER, QDMA_CSR_TIMER_CNT,
+			       pinfo->c2h_tmr_cnt, &xpriv->rx_timer_idx);
+	if (ret < 0)
+		goto release_slots;
 
-	index = onic_arr_find(csr_conf.c2h_cnt_th, QDMA_GLOBAL_CSR_ARRAY_SZ,
-			      xpriv->pinfo->c2h_cnt_thr);
-	if (index < 0) {
-		dev_err(&xpriv->pcidev->dev,
-			"%s: Expected default C2H count threshold count %d not found\n",
-			__func__, xpriv->pinfo->c2h_cnt_thr);
-		return index;
-	}
-	xpriv->rx_cnt_th_idx = index;
+	ret = onic_csr_ref_get(xpriv, ONIC_CSR_REF_CNT_TH, QDMA_CSR_CNT_TH,
+			       pinfo->c2h_cnt_thr, &xpriv->rx_cnt_th_idx);
+	if (ret < 0)
+		goto release_slots;
 
-	index = onic_arr_find(csr_conf.c2h_buf_sz, QDMA_GLOBAL_CSR_ARRAY_SZ,
-			      xpriv->pinfo->c2h_buf_sz);
-	if (index < 0) {
-		dev_err(&xpriv->pcidev->dev,
-			"%s: Expected default C2H Buffer size %d not found",
-			__func__, xpriv->pinfo->c2h_buf_sz);
-		return index;
+	ret = onic_csr_ref_get(xpriv, ONIC_CSR_REF_BUF_SZ, QDMA_CSR_BUF_SZ,
+			       pinfo->c2h_buf_sz, &xpriv->rx_buf_sz_idx);
+	if (ret < 0)
+		goto release_slots;
+
+	if (pinfo->small_buf_queues) {
+		ret = onic_csr_ref_get(xpriv, ONIC_CSR_REF_SMALL_BUF_SZ,
+				       QDMA_CSR_BUF_SZ, pinfo->c2h_buf_sz_small,
+				       &xpriv->rx_small_buf_sz_idx);
+		if (ret < 0)
+			goto release_slots;
 	}
-	xpriv->rx_buf_sz_idx = index;
 	return 0;
+
+release_slots:
+	onic_csr_slots_release(xpriv);
+	return ret;
+}
+
+/* This function maps the interrupt aggregation ring size in entries onto
+ * libqdma's 4KB ring size index
+ */
+static u8 onic_intr_rngsz(struct onic_priv *xpriv)
+{
+	int nb_vecs = xpriv->qdma_dev_conf.data_msix_qvec_max;
+	int entries = xpriv->pinfo->intr_ring_sz;
+	int idx;
+
+	if (!entries)
+		entries = ONIC_INTR_RING_ENTRIES;
+	idx = DIV_ROUND_UP(entries, ONIC_INTR_RING_ENTRIES) - 1;
+	idx = clamp_t(int, idx, INTR_RING_SZ_4KB, INTR_RING_SZ_32KB);
+	if (entries != (idx + 1) * ONIC_INTR_RING_ENTRIES)
+		dev_warn(&xpriv->pcidev->dev,
+			 "%s: intr_ring_sz %d rounded to %d\n", __func__,
+			 entries, (idx + 1) * ONIC_INTR_RING_ENTRIES);
+
+	/* every queue may have one entry pending in the ring of its vector */
+	if ((idx + 1) * ONIC_INTR_RING_ENTRIES <
+	    DIV_ROUND_UP(2 * xpriv->nb_queues, nb_vecs))
+		dev_warn(&xpriv->pcidev->dev,
+			 "%s: intr ring of %d entries is small for %d queues on %d vectors\n",
+			 __func__, (idx + 1) * ONIC_INTR_RING_ENTRIES,
+			 xpriv->nb_queues, nb_vecs);
+
+	return idx;
 }
 
 /* Configure QDMA Device, Global CSR Registers */
@@ -1005,13 +1636,26 @@ static int onic_qdma_setup(struct onic_priv *xpriv)
 	if (!xpriv->pinfo->poll_mode)
 		xpriv->qdma_dev_conf.intr_moderation =
 			xpriv->pinfo->intr_mod_en;
+	xpriv->qdma_dev_conf.wq_unbound = xpriv->pinfo->wq_unbound;
 	xpriv->qdma_dev_conf.qsets_max = xpriv->pinfo->queue_max;
 	xpriv->qdma_dev_conf.qsets_base = xpriv->pinfo->queue_base;
 	xpriv->qdma_dev_conf.pdev = xpriv->pcidev;
-	if (xpriv->pinfo->poll_mode)
+	if (xpriv->pinfo->poll_mode) {
 		xpriv->qdma_dev_conf.qdma_drv_mode = POLL_MODE;
-	else
+		xpriv->qdma_dev_conf.poll_spin_us =
+			max(xpriv->pinfo->poll_spin_us, 0);
+	} else if (xpriv->pinfo->indirect_intr) {
+		xpriv->qdma_dev_conf.qdma_drv_mode = INDIRECT_INTR_MODE;
+		/* one aggregation ring per available data vector, a single
+		 * vector only when no more are left
+		 */
+		xpriv->qdma_dev_conf.data_msix_qvec_max =
+			clamp_t(int, min(xpriv->nb_data_vecs, xpriv->nb_queues),
+				1, QDMA_NUM_DATA_VEC_FOR_INTR_MAX);
+		xpriv->qdma_dev_conf.intr_rngsz = onic_intr_rngsz(xpriv);
+	} else {
 		xpriv->qdma_dev_conf.qdma_drv_mode = DIRECT_INTR_MODE;
+	}
 
 	ret = qdma_device_open(onic_drv_name, &xpriv->qdma_dev_conf, &xpriv->dev_handle);
 	if (ret != 0) {
@@ -1207,6 +1851,7 @@ static int onic_pci_probe(struct pci_dev *pdev,
 	xpriv->netdev = netdev;
 	xpriv->pcidev = pdev;
 	xpriv->pinfo = pinfo;
+	xpriv->rx_trig_mode = TRIG_MODE_COMBO;
 
 	memset(&saddr, 0, sizeof(struct sockaddr));
 	memcpy(saddr.sa_data, pinfo->mac_addr, 6);
@@ -1264,6 +1909,11 @@ static int onic_pci_probe(struct pci_dev *pdev,
 
 	onic_init_reta(xpriv);
 
+	if (pinfo->rx_hash_en) {
+		netdev->hw_features |= NETIF_F_RXHASH;
+		netdev->features |= NETIF_F_RXHASH;
+	}
+
 	ret = register_netdev(netdev);
 	if (ret != 0) {
 		dev_err(&pdev->dev, "%s: Failed to register network driver\n",
@@ -1280,6 +1930,7 @@ disable_cmac:
 iounmap_bar:
 	iounmap(xpriv->bar_base);
 close_qdma_device:
+	onic_csr_slots_release(xpriv);
 	qdma_device_close(pdev, xpriv->dev_handle);
 destroy_kmem_cache:
 	kmem_cache_destroy(xpriv->dma_req);
@@ -1314,6 +1965,7 @@ static void onic_pci_remove(struct pci_dev *pdev)
 	onic_disable_cmac(xpriv);
 	if (xpriv->bar_base)
 		iounmap(xpriv->bar_base);
+	onic_csr_slots_release(xpriv);
 	qdma_device_close(pdev, xpriv->dev_handle);
 	kmem_cache_destroy(xpriv->dma_req);
 	kfree(xpriv->pinfo);
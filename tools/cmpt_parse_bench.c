@@ -0,0 +1,207 @@
+/*
+ * Host microbenchmark of the ST C2H 8B completion entry parsers of
+ * libqdma/qdma_st_c2h.c: parse_cmpl_batch_8b() against the per-entry path
+ * (parse_cmpl_entry(), descq_cmpl_err_check(), is_new_cmpl_entry()).
+ *
+ * The parsers are taken verbatim from the driver sources and built against
+ * the stub types below, only the fields of struct qdma_descq they use are
+ * kept. Packet delivery (rcv_pkt) is left out, both loops only sum up the
+ * parsed (len, desc_used) pairs and advance with cmpt_next().
+ *
+ * Build and run from the top of the tree:
+ *
+ *	{ sed -n '/^#define [SFML]_C2H_CMPT_ENTRY/p' libqdma/qdma_regs.h; \
+ *	  sed -n '/^struct qdma_ul_cmpt_info {/,/^};/p' \
+ *		libqdma/libqdma_export.h; \
+ *	  sed -n -e '/^void cmpt_next/,/^}/p' \
+ *		-e '/^static inline bool is_new_cmpl_entry/,/^}/p' \
+ *		-e '/^int parse_cmpl_entry/,/^}/p' \
+ *		-e '/^#define QDMA_CMPT_BATCH_MAX/,/^};/p' \
+ *		-e '/^static int parse_cmpl_batch_8b/,/^}/p' \
+ *		-e '/^static int descq_cmpl_err_check/,/^}/p' \
+ *		libqdma/qdma_st_c2h.c; } > /tmp/cmpt_parse.inc
+ *	cc -O2 -Wall -I/tmp -o /tmp/cmpt_parse_bench tools/cmpt_parse_bench.c
+ *	/tmp/cmpt_parse_bench
+ *
+ * Every pass consumes a 1024 entry ring of valid entries in polls of
+ * <budget> entries, the colour bits are flipped between passes outside the
+ * timed region. The ring stays cache hot, so the numbers are the parse cost
+ * only, without the cache miss on entries freshly written by the device.
+ *
+ * Measured on a single vCPU Intel Xeon VM, gcc 12.2 -O2, each cell the
+ * best of 6 invocations (the program itself keeps the best of 5 runs):
+ *
+ *	budget   per-entry   batch    (ns/entry)
+ *	    64        5.06    3.17
+ *	     8        5.11    3.28
+ *	     4        5.24    3.30
+ *	     1        6.54    6.22
+ *
+ * The batch parser takes about 35% off the parse cost once a poll sees two
+ * or more new entries. With one entry per poll both paths are dominated by
+ * the per call overhead.
+ */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef uint64_t __be64;
+
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+/* coherent memory on x86, a compiler barrier like the kernel's */
+#define dma_rmb()		__asm__ __volatile__("" : : : "memory")
+#define pr_err(...)		fprintf(stderr, __VA_ARGS__)
+#define pr_warn(...)		fprintf(stderr, __VA_ARGS__)
+#define print_hex_dump(...)	do { } while (0)
+
+struct qdma_queue_conf {
+	char name[32];
+	unsigned int rngsz_cmpt;
+	u8 cmpl_udd_en:1;
+};
+
+struct qdma_descq {
+	struct qdma_queue_conf conf;
+	u8 *desc_cmpt;
+	void *desc_cmpt_cur;
+	unsigned int cidx_cmpt;
+	u8 err:1;
+	u8 color:1;
+	unsigned char cmpt_entry_len;
+};
+
+#include "cmpt_parse.inc"
+
+#define RING_SZ		1024
+#define PASSES		20000
+#define RUNS		5
+
+static int run_entry(struct qdma_descq *descq, int budget, u64 *sum)
+{
+	int proc_cnt = 0;
+
+	while (proc_cnt < budget) {
+		struct qdma_ul_cmpt_info cmpl;
+
+		memset(&cmpl, 0, sizeof(struct qdma_ul_cmpt_info));
+		if (parse_cmpl_entry(descq, &cmpl) < 0 ||
+		    descq_cmpl_err_check(descq, &cmpl) < 0)
+			abort();
+		if (!is_new_cmpl_entry(descq, &cmpl))
+			break;
+		*sum += cmpl.len + cmpl.f.desc_used;
+		cmpt_next(descq);
+		proc_cnt++;
+	}
+
+	return proc_cnt;
+}
+
+static int run_batch(struct qdma_descq *descq, int budget, u64 *sum)
+{
+	struct qdma_cmpt_tuple tup[QDMA_CMPT_BATCH_MAX];
+	int proc_cnt = 0;
+
+	while (proc_cnt < budget) {
+		int n = parse_cmpl_batch_8b(descq, tup, budget - proc_cnt);
+		int i;
+
+		if (n < 0)
+			abort();
+		if (!n)
+			break;
+		for (i = 0; i < n; i++) {
+			*sum += tup[i].len + tup[i].desc_used;
+			cmpt_next(descq);
+			proc_cnt++;
+		}
+	}
+
+	return proc_cnt;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double bench(int (*run)(struct qdma_descq *, int, u64 *), int budget,
+		    u64 *sum)
+{
+	static __be64 ring[RING_SZ] __attribute__((aligned(64)));
+	struct qdma_descq descq;
+	double best = 0;
+	int r, p, i;
+
+	srand(1);
+	for (i = 0; i < RING_SZ; i++)
+		ring[i] = ((u64)(60 + rand() % 1455) <<
+			   S_C2H_CMPT_ENTRY_LENGTH) |
+			  F_C2H_CMPT_ENTRY_F_DESC_USED |
+			  F_C2H_CMPT_ENTRY_F_COLOR;
+
+	memset(&descq, 0, sizeof(descq));
+	descq.conf.rngsz_cmpt = RING_SZ;
+	descq.desc_cmpt = (u8 *)ring;
+	descq.desc_cmpt_cur = ring;
+	descq.color = 1;
+	descq.cmpt_entry_len = 8;
+
+	for (r = 0; r < RUNS; r++) {
+		double t = 0;
+
+		*sum = 0;
+		for (p = 0; p < PASSES; p++) {
+			double t0 = now_ns();
+			int done = 0;
+
+			while (done < RING_SZ)
+				done += run(&descq, budget, sum);
+			t += now_ns() - t0;
+
+			/* the device writes the next lap with the other colour */
+			for (i = 0; i < RING_SZ; i++)
+				ring[i] ^= F_C2H_CMPT_ENTRY_F_COLOR;
+		}
+		t /= (double)PASSES * RING_SZ;
+		if (!r || t < best)
+			best = t;
+	}
+
+	return best;
+}
+
+int main(void)
+{
+	static const int budgets[] = { 64, 8, 4, 1 };
+	unsigned int i;
+
+	printf("budget   per-entry   batch    (ns/entry)\n");
+	for (i = 0; i < sizeof(budgets) / sizeof(budgets[0]); i++) {
+		u64 sum_entry, sum_batch;
+		double t_entry = bench(run_entry, budgets[i], &sum_entry);
+		double t_batch = bench(run_batch, budgets[i], &sum_batch);
+
+		if (sum_entry != sum_batch) {
+			fprintf(stderr, "parsers disagree: %llu != %llu\n",
+				(unsigned long long)sum_entry,
+				(unsigned long long)sum_batch);
+			return 1;
+		}
+		printf("%6d   %9.2f   %5.2f\n", budgets[i], t_entry, t_batch);
+	}
+
+	return 0;
+}